@@ -3,13 +3,13 @@
 
 #include <algorithm>
 #include <fstream>
-#include <list>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "io.h"
 #include "interpolation.h"
+#include "keyframefile.h"
 #include "scenegraph.h"
 #include "sgutils.h"
 
@@ -18,14 +18,90 @@ namespace Animation {
 	using SceneRbtVector = std::vector<std::shared_ptr<SgRbtNode>>;
 	using Frame = std::vector<RigTForm>;
 
+	//! Interpolation schemes used for playback
+	enum InterpolationMode {
+		LINEAR,         // piecewise lerp / slerp
+		CATMULL_ROM     // Catmull-Rom splines through the keyframes
+	};
+
+	//! File formats understood by exportKeyframeList
+	enum KeyframeFileFormat {
+		TEXT_FORMAT,    // human readable, one line per frame
+		BINARY_FORMAT,  // little-endian container described in keyframefile.h
+		COMPRESSED_FORMAT   // the same container holding quantized, reduced keys
+	};
+
+	//! Finds the keyframe segment containing a playback time in an ascending time array
+	//! Lookups at non-decreasing times (i.e. during playback) are answered in O(1)
+	//! by checking the segment found last and the one after it, other lookups
+	//! fall back to a binary search.
+	class SegmentCursor {
+	public:
+		SegmentCursor() : last_(0) {}
+
+		//! Returns p such that times[p] <= t < times[p + 1],
+		//! -1 if t < times[0] and times.size() - 1 if t >= times.back()
+		int find(const std::vector<double>& times, double t) {
+			const int n = static_cast<int>(times.size());
+			for (int p = std::max(last_, 0); p <= last_ + 1 && p + 1 < n; ++p) {
+				if (times[p] <= t && t < times[p + 1])
+					return last_ = p;
+			}
+			last_ = static_cast<int>(std::upper_bound(times.begin(), times.end(), t) - times.begin()) - 1;
+			return last_;
+		}
+
+		//! Locate the playback time t among the keyframe times
+		//! Sets p to the position of the keyframe that starts the segment and alpha to the
+		//! fraction of the segment before t. Playback runs from the second to the third
+		//! last keyframe (the outer ones are Catmull-Rom neighbours only), before it the
+		//! second keyframe is held. Returns false past the end.
+		bool locate(const std::vector<double>& times, double t, int& p, double& alpha) {
+			const int n = static_cast<int>(times.size());
+			if (n < 4)
+				return false;
+			p = find(times, t);
+			if (p < 1) {
+				p = 1;
+				alpha = 0;
+				return true;
+			}
+			if (p >= n - 2)
+				return false;
+			alpha = (t - times[p]) / (times[p + 1] - times[p]);
+			return true;
+		}
+
+	private:
+		int last_;
+	};
+
+	//! Keyframes are stored contiguously so that random access by index
+	//! (used on every interpolated frame) is O(1). The current keyframe is
+	//! tracked by its position in the vector, UNDEFINED_IDX if there is none.
+	//!
+	//! For playback, a structure-of-arrays copy of all keyframes (one flat
+	//! array per component, strided by the number of nodes) is rebuilt lazily
+	//! after the keyframes are edited. This also drops the cached spline segments.
+	//! Data derived outside of the list (e.g. BakedAnimation) checks getRevision().
+	//!
+	//! Every keyframe has a time, measured in units of g_msBetweenKeyFrames and
+	//! strictly ascending along the list. New keyframes are placed one unit after
+	//! the current one (later keyframes move back by one unit), so by default
+	//! keyframe #idx sits at time idx; shiftCurrentKeyframe makes the spacing uneven.
 	class KeyframeList {
 
 	public:
+		using iterator = std::vector<Frame>::iterator;
+
 		//! Default constructor
 		//! Creates an empty list of keyframe
 		KeyframeList() {
-			keyframes_ = std::list<Frame>();
-			currentKeyframeIter = keyframes_.end();
+			keyframes_ = std::vector<Frame>();
+			currentKeyframeIdx_ = UNDEFINED_IDX;
+			soaDirty_ = true;
+			revision_ = 0;
+			mode_ = LINEAR;
 		}
 
 		//! Default destructor
@@ -34,38 +110,36 @@ namespace Animation {
 		//! Getter for current keyframe
 		//! Warning: Call on empty list is undefined
 		Frame& getCurrentKeyframe() {
-			return *currentKeyframeIter;
+			markEdited();    // the caller may modify the frame through the reference
+			return keyframes_[currentKeyframeIdx_];
 		}
 
 		//! Get frame by index
 		//! Index should be in range [-1, n] 
 		//! where n = length of keyframes - 1
-		Frame getFrameByIdx(int idx) {
-			assert(idx >= -1 && idx < keyframes_.size() - 1);
-			std::list<Frame>::iterator iter = keyframes_.begin();
-			for (int i = -1; i < idx; ++i) {
-				iter++;
-			}
-			return *iter;
+		const Frame& getFrameByIdx(int idx) const {
+			assert(idx >= -1 && idx + 1 < static_cast<int>(keyframes_.size()));
+			return keyframes_[idx + 1];
 		}
 
 		//! Replace the RBT of currently selected keyframe with the input
-		void updateCurrentKeyframe(Frame frame) {
-			*currentKeyframeIter = frame;
+		void updateCurrentKeyframe(const Frame& frame) {
+			keyframes_[currentKeyframeIdx_] = frame;
+			markEdited();
 		}
 
 		//! Replace the current keyframe iterator with the input
-		void setCurrentKeyframeAs(std::list<Frame>::iterator iter) {
-			currentKeyframeIter = iter;
+		void setCurrentKeyframeAs(iterator iter) {
+			currentKeyframeIdx_ = static_cast<int>(iter - keyframes_.begin());
 		}
 
 		//! Returns the iterator pointing at the first keyframe
-		std::list<Frame>::iterator begin() {
+		iterator begin() {
 			return keyframes_.begin();
 		}
 
 		//! Returns the iterator pointing at the last keyframe
-		std::list<Frame>::iterator end() {
+		iterator end() {
 			return keyframes_.end();
 		}
 
@@ -74,6 +148,52 @@ namespace Animation {
 			return keyframes_.size();
 		}
 
+		//! Returns a counter that changes whenever the keyframes may have been edited
+		unsigned getRevision() const {
+			return revision_;
+		}
+
+		//! Returns the interpolation scheme used by interpolateKeyframes
+		InterpolationMode getInterpolationMode() const {
+			return mode_;
+		}
+
+		//! Select the interpolation scheme used by interpolateKeyframes
+		void setInterpolationMode(InterpolationMode mode) {
+			mode_ = mode;
+		}
+
+		//! Time of the current keyframe
+		//! Warning: Call on empty list is undefined
+		double getCurrentKeyframeTime() const {
+			return times_[currentKeyframeIdx_];
+		}
+
+		//! Playback time at which interpolateKeyframes reports the end (the time
+		//! of the second last keyframe), 0 with fewer than 4 keyframes
+		double getEndTime() const {
+			return times_.size() < 4 ? 0 : times_[times_.size() - 2];
+		}
+
+		//! Move the current keyframe and all keyframes after it by dt time units,
+		//! which lengthens (dt > 0) or shortens (dt < 0) the segment before it
+		//! Returns false and does nothing if the segment would vanish
+		bool shiftCurrentKeyframe(double dt) {
+			if (currentKeyframeIdx_ == UNDEFINED_IDX) {
+				std::cerr << "Current keyframe is undefined! (list is empty)\n";
+				return false;
+			}
+			if (currentKeyframeIdx_ > 0 && times_[currentKeyframeIdx_] + dt <= times_[currentKeyframeIdx_ - 1]) {
+				std::cerr << "Keyframes cannot be moved past the previous one!\n";
+				return false;
+			}
+			for (std::size_t p = currentKeyframeIdx_; p < times_.size(); ++p) {
+				times_[p] += dt;
+			}
+			markEdited();
+			return true;
+		}
+
 		//! Returns true if the keyframe list is empty,
 		//! false otherwise
 		bool empty() {
@@ -81,16 +201,23 @@ namespace Animation {
 		}
 
 		//! Add new keyframe to the list
-		void addNewKeyframe(Frame& keyframe) {
+		void addNewKeyframe(const Frame& keyframe) {
+			markEdited();
 			if (keyframes_.empty()) {
 				keyframes_.push_back(keyframe);
-				currentKeyframeIter = keyframes_.begin();
+				times_.push_back(-1);    // keyframes are numbered from -1
+				currentKeyframeIdx_ = 0;
 			}
 			else {
 				// otherwise, insert a new frame next to the current keyframe
-				currentKeyframeIter++;
-				keyframes_.insert(currentKeyframeIter, keyframe);    // 'insert' will insert new element before the current iterator
-				currentKeyframeIter--;
+				// one time unit later, pushing the following keyframes back
+				const double time = times_[currentKeyframeIdx_] + 1;
+				currentKeyframeIdx_++;
+				for (std::size_t p = currentKeyframeIdx_; p < times_.size(); ++p) {
+					times_[p] += 1;
+				}
+				keyframes_.insert(keyframes_.begin() + currentKeyframeIdx_, keyframe);    // 'insert' will insert new element before the given position
+				times_.insert(times_.begin() + currentKeyframeIdx_, time);
 			}
 		}
 
@@ -108,22 +235,28 @@ namespace Animation {
 				return;
 			}
 			else {
+				markEdited();
+
 				// Case (1)
 				if (keyframes_.size() == 1) {
-					keyframes_.erase(currentKeyframeIter);
-					currentKeyframeIter = keyframes_.end();
+					keyframes_.clear();
+					times_.clear();
+					currentKeyframeIdx_ = UNDEFINED_IDX;
 				}
 				else {
-					// Case (2) - (ii)
-					if (currentKeyframeIter == keyframes_.begin()) {
-						currentKeyframeIter = keyframes_.erase(currentKeyframeIter);
+					// the following keyframes move forward by the length of the removed segment
+					const int p = currentKeyframeIdx_;
+					const double gap = p > 0 ? times_[p] - times_[p - 1] : times_[p + 1] - times_[p];
+					for (std::size_t q = p + 1; q < times_.size(); ++q) {
+						times_[q] -= gap;
 					}
-					// Case (2) - (i)
-					else {
-						std::list<Frame>::iterator prevIter = currentKeyframeIter;
-						prevIter--;
-						currentKeyframeIter = keyframes_.erase(currentKeyframeIter);
-						currentKeyframeIter = prevIter;
+					keyframes_.erase(keyframes_.begin() + p);
+					times_.erase(times_.begin() + p);
+
+					// Case (2) - (i): step back to the frame before the deleted one
+					// Case (2) - (ii): the next frame slides into the erased slot, so keep the index
+					if (currentKeyframeIdx_ > 0) {
+						currentKeyframeIdx_--;
 					}
 					sendCurrentKeyframeToScene(nodes);
 				}
@@ -132,30 +265,27 @@ namespace Animation {
 
 		//! Copy current keyframe to the scene graph
 		void sendCurrentKeyframeToScene(SceneRbtVector& nodes) {
-			if (currentKeyframeIter == keyframes_.end()) {
+			if (currentKeyframeIdx_ == UNDEFINED_IDX) {
 				std::cerr << "Current keyframe is undefined!\n";
 			}
 			else {
-				const Frame currentKeyframe = *currentKeyframeIter;
-				setSgRbtNodes(nodes, currentKeyframe);
+				setSgRbtNodes(nodes, keyframes_[currentKeyframeIdx_]);
 			}
 		}
 
 		//! Advance to the next keyframe if possible
 		//! If already at the end of the list, do nothing
 		void advanceFrame(SceneRbtVector& nodes) {
-			if (currentKeyframeIter == keyframes_.end()) {
+			if (currentKeyframeIdx_ == UNDEFINED_IDX) {
 				std::cerr << "Current keyframe is undefined! (list is empty)\n";
 			}
 			else {
-				std::list<Frame>::iterator lastElem = keyframes_.end();
-				lastElem--;
-				if (currentKeyframeIter == lastElem) {
+				if (currentKeyframeIdx_ + 1 == static_cast<int>(keyframes_.size())) {
 					std::cerr << "This is the last keyframe!\n";
 				}
 				else {
-					currentKeyframeIter++;
-					setSgRbtNodes(nodes, *currentKeyframeIter);
+					currentKeyframeIdx_++;
+					setSgRbtNodes(nodes, keyframes_[currentKeyframeIdx_]);
 				}
 			}
 		}
@@ -163,24 +293,38 @@ namespace Animation {
 		//! Retreat to the previous keyframe if possible
 		//! If already at the beginning of the list, do nothing
 		void retreatFrame(SceneRbtVector& nodes) {
-			if (currentKeyframeIter == keyframes_.end()) {
+			if (currentKeyframeIdx_ == UNDEFINED_IDX) {
 				std::cerr << "Current keyframe is undefined! (list is empty)\n";
 			}
 			else {
-				if (currentKeyframeIter == keyframes_.begin())
+				if (currentKeyframeIdx_ == 0)
 					std::cerr << "This is the first keyframe!\n";
 				else {
-					currentKeyframeIter--;
-					setSgRbtNodes(nodes, *currentKeyframeIter);
+					currentKeyframeIdx_--;
+					setSgRbtNodes(nodes, keyframes_[currentKeyframeIdx_]);
 				}
 			}
 		}
 
 		//! Export the list of keyframes held by this instance
-		void exportKeyframeList(std::string filename) {
+		void exportKeyframeList(std::string filename, KeyframeFileFormat format = TEXT_FORMAT) {
 
 			if (keyframes_.empty()) {
-				// Do nothing
+				std::cerr << "There's no keyframe!\n";
+				return;
+			}
+
+			if (format == BINARY_FORMAT || format == COMPRESSED_FORMAT) {
+				KeyframeCompression::Settings settings;
+				settings.translationTolerance = 1e-3;
+				settings.rotationTolerance = 0.25 * CS175_PI / 180;
+				const bool written = format == BINARY_FORMAT
+					? KeyframeFile::write(filename, keyframes_, &times_)
+					: KeyframeFile::writeCompressed(filename, keyframes_, settings, &times_);
+				if (written) {
+					std::cout << "Exported file located at: " << filename << "\n";
+				}
+				return;
 			}
 
 			//! Get number of frames in the list & number of RBTs in one keyframe
@@ -193,10 +337,10 @@ namespace Animation {
 			if (file.is_open()) {
 				file << numFrames << " " << numRbts << "\n";
 
-				for (std::list<Frame>::iterator frameIter = keyframes_.begin(); frameIter != keyframes_.end(); ++frameIter) {
-					Frame currentFrame = *frameIter;
-					for (std::vector<RigTForm>::iterator rbtIter = currentFrame.begin(); rbtIter != currentFrame.end(); ++rbtIter) {
-						RigTForm currentRbt = *rbtIter;
+				for (std::vector<Frame>::const_iterator frameIter = keyframes_.begin(); frameIter != keyframes_.end(); ++frameIter) {
+					const Frame& currentFrame = *frameIter;
+					for (Frame::const_iterator rbtIter = currentFrame.begin(); rbtIter != currentFrame.end(); ++rbtIter) {
+						const RigTForm& currentRbt = *rbtIter;
 						Cvec3 t = currentRbt.getTranslation();
 						Quat q = currentRbt.getRotation();
 						file << t[0] << " " << t[1] << " " << t[2] << " " << q[0] << " " << q[1] << " " << q[2] << " " << q[3];
@@ -212,13 +356,25 @@ namespace Animation {
 		}
 
 		//! Import the list of keyframes stored in the disk
+		//! Binary files are recognized by their header and read through a memory mapping,
+		//! anything else is parsed as the text format
 		void importKeyframeList(std::string filename) {
 
+			std::vector<Frame> keyframes_in = std::vector<Frame>();
+			std::vector<double> times_in;
+
+			MappedFile mapped(filename);
+			if (mapped.isOpen() && KeyframeFile::hasMagic(mapped.data(), mapped.size())) {
+				if (!KeyframeFile::read(mapped, keyframes_in, &times_in, -1)) {
+					keyframes_in.clear();
+				}
+				setImportedKeyframes(keyframes_in, times_in, filename);
+				return;
+			}
+
 			std::ifstream file(filename); 
 			std::string line;
 
-			std::list<Frame> keyframes_in = std::list<Frame>();
-
 			if (file.is_open()) {
 
 				int numFrames = -1;
@@ -273,40 +429,43 @@ namespace Animation {
 				file.close();
 			}
 
-			if (keyframes_in.empty()) {
-				std::cout << "Something went wrong! Doing nothing...\n";
-			}
-			else {
-				std::cout << "Imported file located at: " << filename << "\n";
-				keyframes_ = keyframes_in;
-				currentKeyframeIter = keyframes_.begin();    // set the first frame as the current keyframe
+			// the text format has no times, keyframes are one unit apart
+			for (std::size_t f = 0; f < keyframes_in.size(); ++f) {
+				times_in.push_back(static_cast<double>(f) - 1);
 			}
+			setImportedKeyframes(keyframes_in, times_in, filename);
 		}
 
 		//! Interpolate between keyframes
-		//! Return false when reached the end of the keyframes
-		//! Return true otherwise (making animation proceed)
+		//! Return true when reached the end of the keyframes
+		//! Return false otherwise (making animation proceed)
+		//! interFrame is used as an output buffer and is resized to the number of nodes,
+		//! so callers can pass the same frame on every call to avoid reallocation
 		bool interpolateKeyframes(float t, Frame& interFrame) {
-			assert(interFrame.empty());
-
-			int startFrameIdx = floor(t);
-			int endFrameIdx = floor(t + 1);
-			float alpha = t - floor(t);
-
-			if (endFrameIdx >= keyframes_.size() - 2) {
+			int p;
+			double alpha;
+			if (!cursor_.locate(times_, t, p, alpha)) {
 				return true;
 			}
 
-			Frame startFrame = getFrameByIdx(startFrameIdx);
-			Frame endFrame = getFrameByIdx(endFrameIdx);
+			if (soaDirty_) {
+				rebuildSoA();
+			}
 
-			Frame::iterator startIter = startFrame.begin();
-			Frame::iterator endIter = endFrame.begin();
+			// the segment runs from the keyframe at position p to the one at p + 1
+			const int numRbts = static_cast<int>(keyframes_[0].size());
+			if (mode_ == CATMULL_ROM) {
+				// spline segment s uses the keyframes at positions s, ..., s + 3
+				spline_.evaluate(soaKeyframes_, p - 1, alpha, soaInterFrame_);
+			}
+			else {
+				Interpolation::linearBatch(soaKeyframes_, p * numRbts,
+					soaKeyframes_, (p + 1) * numRbts, numRbts, alpha, soaInterFrame_);
+			}
 
-			while (startIter != startFrame.end() && endIter != endFrame.end()) {
-				interFrame.push_back(Interpolation::Linear(*startIter, *endIter, alpha));
-				startIter++;
-				endIter++;
+			interFrame.resize(numRbts);
+			for (int i = 0; i < numRbts; ++i) {
+				interFrame[i] = soaInterFrame_.get(i);
 			}
 
 			return false;
@@ -323,22 +482,64 @@ namespace Animation {
 
 	private:
 		//! Calculate the curernt keyframe index
-		int getCurrentKeyframeIdx() {
-			if (currentKeyframeIter == keyframes_.end()) {
+		int getCurrentKeyframeIdx() const {
+			if (currentKeyframeIdx_ == UNDEFINED_IDX) {
 				return -100;
 			}
-			int idx = -1;
-			std::list<Frame>::iterator iter = keyframes_.begin();
-			while (iter != currentKeyframeIter) {
-				iter++;
-				idx++;
+			return currentKeyframeIdx_ - 1;    // keyframes are numbered from -1
+		}
+
+		//! Replace the keyframes with the ones read from filename
+		//! An empty input means that the import failed
+		void setImportedKeyframes(std::vector<Frame>& keyframes_in, std::vector<double>& times_in, const std::string& filename) {
+			if (keyframes_in.empty()) {
+				std::cout << "Something went wrong! Doing nothing...\n";
+			}
+			else {
+				std::cout << "Imported file located at: " << filename << "\n";
+				keyframes_.swap(keyframes_in);
+				times_.swap(times_in);
+				markEdited();
+				currentKeyframeIdx_ = 0;    // set the first frame as the current keyframe
 			}
-			return idx;
+		}
+
+		//! Invalidate the data derived from the keyframes
+		void markEdited() {
+			soaDirty_ = true;
+			revision_++;
+		}
+
+		//! Copy all keyframes into soaKeyframes_, frame after frame
+		void rebuildSoA() {
+			const int numRbts = static_cast<int>(keyframes_[0].size());
+			soaKeyframes_.resize(static_cast<int>(keyframes_.size()) * numRbts);
+			for (int f = 0; f < static_cast<int>(keyframes_.size()); ++f) {
+				assert(static_cast<int>(keyframes_[f].size()) == numRbts);
+				for (int i = 0; i < numRbts; ++i) {
+					soaKeyframes_.set(f * numRbts + i, keyframes_[f][i]);
+				}
+			}
+			soaInterFrame_.resize(numRbts);
+			spline_.reset(std::max(0, static_cast<int>(keyframes_.size()) - 3), numRbts);
+			soaDirty_ = false;
 		}
 
 	private:
-		std::list<Frame> keyframes_;
-		std::list<Frame>::iterator currentKeyframeIter;
+		static const int UNDEFINED_IDX = -1;
+
+		std::vector<Frame> keyframes_;
+		std::vector<double> times_;    // time of each keyframe, ascending
+		int currentKeyframeIdx_;
+		SegmentCursor cursor_;    // segment lookup of interpolateKeyframes
+
+		Interpolation::RigTFormArray soaKeyframes_;    // all keyframes in SoA layout
+		Interpolation::RigTFormArray soaInterFrame_;    // output buffer of the batched interpolation
+		bool soaDirty_;
+		unsigned revision_;    // bumped by markEdited
+
+		InterpolationMode mode_;
+		Interpolation::CatmullRomSpline spline_;    // cached spline segments, reset along with the SoA copy
 	};
 }
 
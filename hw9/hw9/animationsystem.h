@@ -0,0 +1,144 @@
+#ifndef ANIMATIONSYSTEM_H
+#define ANIMATIONSYSTEM_H
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "animation.h"
+#include "sgutils.h"
+#include "threadpool.h"
+
+namespace Animation {
+
+	//! Plays back many independent characters at once
+	//!
+	//! Every character owns a copy of its timeline, its playback time and the
+	//! scene nodes it drives. evaluate() interpolates all active characters in
+	//! parallel on a thread pool and writes the poses to their nodes in the
+	//! same pass. A character only touches its own timeline and nodes, so no
+	//! locking is needed.
+	class AnimationSystem {
+	public:
+		//! threadPool must outlive this system
+		explicit AnimationSystem(ThreadPool& threadPool)
+			: pool_(threadPool), lastEvaluationMs_(0), averageEvaluationMs_(0) {}
+
+		//! Add a character playing timeline on nodes and returns its id
+		//! nodes may be empty, then the pose is only available through getPose
+		int addCharacter(const KeyframeList& timeline, const SceneRbtVector& nodes, bool loop = false) {
+			Character character;
+			character.timeline = timeline;
+			character.nodes = nodes;
+			character.t = 0;
+			character.loop = loop;
+			character.active = true;
+			characters_.push_back(character);
+			return static_cast<int>(characters_.size()) - 1;
+		}
+
+		int numCharacters() const {
+			return static_cast<int>(characters_.size());
+		}
+
+		//! Set the playback time of a character, measured in keyframes like interpolateKeyframes
+		void setTime(int id, float t) {
+			characters_[id].t = t;
+		}
+
+		//! Advance the playback time of all active characters
+		void advance(float dt) {
+			for (std::size_t i = 0; i < characters_.size(); ++i) {
+				if (characters_[i].active)
+					characters_[i].t += dt;
+			}
+		}
+
+		//! Start or stop a character
+		void setActive(int id, bool active) {
+			characters_[id].active = active;
+		}
+
+		//! A character becomes inactive when it reaches the end of a non-looping timeline
+		bool isActive(int id) const {
+			return characters_[id].active;
+		}
+
+		//! Pose of a character computed by the last evaluate()
+		const Frame& getPose(int id) const {
+			return characters_[id].pose;
+		}
+
+		//! Interpolate all active characters and write their poses to the scene
+		void evaluate() {
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			active_.clear();
+			for (int i = 0; i < static_cast<int>(characters_.size()); ++i) {
+				if (characters_[i].active)
+					active_.push_back(i);
+			}
+
+			pool_.parallelFor(static_cast<int>(active_.size()), 1, [this](int begin, int end) {
+				for (int k = begin; k < end; ++k)
+					evaluateCharacter(characters_[active_[k]]);
+			});
+
+			lastEvaluationMs_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			averageEvaluationMs_ = averageEvaluationMs_ == 0
+				? lastEvaluationMs_
+				: 0.95 * averageEvaluationMs_ + 0.05 * lastEvaluationMs_;
+		}
+
+		//! Wall-clock time of the last evaluate() in milliseconds
+		double getLastEvaluationMs() const {
+			return lastEvaluationMs_;
+		}
+
+		//! Exponential moving average of the evaluate() time in milliseconds
+		double getAverageEvaluationMs() const {
+			return averageEvaluationMs_;
+		}
+
+		void printStats() const {
+			std::cout << active_.size() << " of " << characters_.size() << " characters evaluated in "
+				<< lastEvaluationMs_ << " ms (avg. " << averageEvaluationMs_ << " ms, "
+				<< pool_.numThreads() << " threads)\n";
+		}
+
+	private:
+		struct Character {
+			KeyframeList timeline;
+			SceneRbtVector nodes;
+			Frame pose;
+			float t;
+			bool loop;
+			bool active;
+		};
+
+		static void evaluateCharacter(Character& character) {
+			bool endReached = character.timeline.interpolateKeyframes(character.t, character.pose);
+			if (endReached && character.loop) {
+				// keep the time past the end, so that looping characters stay in phase
+				const double endTime = character.timeline.getEndTime();
+				character.t = endTime > 0 ? static_cast<float>(std::fmod(character.t, endTime)) : 0;
+				endReached = character.timeline.interpolateKeyframes(character.t, character.pose);
+			}
+			if (endReached) {
+				character.active = false;
+				return;
+			}
+			if (!character.nodes.empty())
+				setSgRbtNodes(character.nodes, character.pose);
+		}
+
+		ThreadPool& pool_;
+		std::vector<Character> characters_;
+		std::vector<int> active_;    // indices of the characters evaluated by the last evaluate()
+		double lastEvaluationMs_;
+		double averageEvaluationMs_;
+	};
+}
+
+#endif
@@ -12,7 +12,9 @@
 #include <stdexcept>
 #include <cstdlib>
 #include <cmath>
+#include <limits>
 #include <random>
+#include <chrono>
 
 #include <GL/glew.h>
 #ifdef __APPLE__
@@ -42,6 +44,15 @@
 
 // assignment 5
 #include "animation.h"
+#include "animationsystem.h"
+#include "bakedanimation.h"
+#include "framescheduler.h"
+#include "fursimulation.h"
+#include "fursimulationthread.h"
+#include "signeddistancefield.h"
+#include "threadpool.h"
+#include "keyframecompression.h"
+#include "keyframestream.h"
 
 // assignment 6
 #include "geometry.h"    // revised
@@ -81,7 +92,7 @@ static float g_frustFovY = g_frustMinFov; // FOV in y direction (updated by upda
 static const float g_frustNear = -0.1;    // near plane
 static const float g_frustFar = -50.0;    // far plane
 static const float g_groundY = -2.0;      // y coordinate of the ground
-static const float g_groundSize = 10.0;   // half the ground length
+static constexpr float g_groundSize = 10.0; // half the ground length
 
 static int g_windowWidth = 512;
 static int g_windowHeight = 512;
@@ -94,7 +105,7 @@ static std::shared_ptr<Material> g_redDiffuseMat, g_blueDiffuseMat, g_bumpFloorM
                                 g_arcballMat, g_pickingMat, g_lightMat, g_purpleSpecularMat;
 std::shared_ptr<Material> g_overridingMaterial;    // used for uniform material'ing' in picking mode
 static std::shared_ptr<Material> g_bunnyMat;
-static std::vector<std::shared_ptr<Material>> g_bunnyShellMats;
+static std::shared_ptr<Material> g_bunnyShellMat;    // all shell layers, drawn in one instanced draw call
 
 // Geometry
 typedef SgGeometryShapeNode MyShapeNode;
@@ -102,15 +113,30 @@ typedef SgGeometryShapeNode MyShapeNode;
 // Vertex buffer and index buffer associated with the ground and cube geometry
 static shared_ptr<Geometry> g_ground, g_cube, g_sphere;
 static std::shared_ptr<SimpleGeometryPN> g_bunnyGeometry;
-static std::vector<std::shared_ptr<SimpleGeometryPNX> > g_bunnyShellGeometries;
+static std::shared_ptr<BufferObjectGeometry> g_bunnyShellGeometry;    // base mesh and hair tips, drawn once per shell
+static std::shared_ptr<FormattedVbo> g_bunnyShellTipVbo;    // aTip of every triangle corner, updated where the tips moved
+static std::vector<int> g_shellCornerVertex;    // mesh vertex of every triangle corner of the shell base mesh
+static std::vector<Cvec3f> g_shellCornerTips;   // staging for g_bunnyShellTipVbo
+
+// Format of g_bunnyShellTipVbo: hair tip in object frame
+static const VertexFormat g_hairTipFormat = VertexFormat(sizeof(Cvec3f))
+                                            .put("aTip", 3, GL_FLOAT, GL_FALSE, 0);
 
 // Bunny geometry parameters
 static const int g_numShells = 24; // constants defining how many layers of shells
+static const int g_minShells = 4;  // fewest layers drawn for a far away bunny
+static const double g_shellsPerFurPixel = 1.0;  // layers per pixel of fur height on screen
 static double g_furHeight = 0.21;
 static double g_hairyness = 0.7;
+static double g_shellLevel = g_numShells;  // layers used by the last frame, see updateShellLod
+static Cvec3 g_bunnyCenter;         // bounding sphere of the bunny mesh in object frame
+static double g_bunnyRadius = 0;
 
 // Mesh object for holding bunny mesh
 static Mesh g_bunnyMesh;
+static SignedDistanceField g_bunnySdf;    // of g_bunnyMesh in object frame, the fur tips collide with it
+static const int g_sdfResolution = 32;    // grid points along the longest side of the bunny
+static const float g_sdfPadding = 0.1f;   // grid extent beyond the bunny, a few collision margins
 
 // Scene graph nodes
 static std::shared_ptr<SgRootNode> g_world;
@@ -141,154 +167,162 @@ static int g_msBetweenKeyFrames = 2000;    // 2 seconds between keyframes
 static float g_deformSpeed = 500;
 static int g_animationFramesPerSecond = 60;    // frames to render per second during animation
 static bool g_playing = false;
+static bool g_useBakedAnimation = false;    // play back from g_bakedAnimation when it is up to date
+static Animation::BakedAnimation g_bakedAnimation;
+static bool g_streaming = false;    // playing back g_keyframeStream instead of g_keyframes
+static Animation::KeyframeStream g_keyframeStream;
 
 // Assignment 9
 // Global variables for used physical simulation
 static bool g_shellNeedsUpdate = false;
-static const Cvec3 g_gravity(0, -0.5, 0);  // gavity vector
+static const Cvec3f g_gravity(0, -0.5f, 0);  // gavity vector
 static double g_timeStep = 0.02;
 static double g_numStepsPerFrame = 10;
 static double g_damping = 0.96;
+static FurSimulation::Integrator g_furIntegrator = FurSimulation::EXPLICIT;
+static int g_verletStepsPerFrame = 2;    // steps per frame of the VERLET integrator, covering the same time
 static double g_stiffness = 4;
+static double g_sleepSpeed = 1e-4;    // fur regions whose tips are all slower and
+static double g_sleepForce = 5e-4;    // less pulled across their hairs stop being simulated
+static double g_furCollisionMargin = 0.02;    // distance the tips keep from g_bunnySdf
 static int g_simulationsPerSecond = 60;
 
-static std::vector<Cvec3> g_tipPos,        // should be hair tip pos in world-space coordinates
-g_tipVelocity;   // should be hair tip velocity in world-space coordinates
+static ThreadPool g_threadPool;             // one thread per core, used by g_furSimulation
+static FurSimulation g_furSimulation(g_threadPool);    // hair tips of the bunny, in world-space coordinates
+static FurSimulationThread g_furSimulationThread(g_furSimulation, g_simulationsPerSecond);    // steps g_furSimulation
+static std::vector<Cvec3f> g_tipPosObject;  // hair tips in object coordinates, for the shells
+static const float g_tipMotionThreshold = 1e-4f;    // tips that moved less (in object coordinates) are not re-uploaded
+static const int g_tipUploadMergeGap = 64;          // dirty corner runs at most this far apart are uploaded together
+static TipMotionTracker g_tipMotion(g_tipMotionThreshold);    // hair tips as last uploaded to g_bunnyShellTipVbo
+static double g_tipUploadThreshold = g_tipMotionThreshold;    // threshold of g_tipMotion, raised for a small bunny
+static int g_numTipUploads = 0;           // glBufferSubData calls of the last shell update
+
+// Frame loop driving the animation playback, the simulation runs on g_furSimulationThread
+static FrameScheduler g_frameScheduler(g_animationFramesPerSecond, 0);
+static double g_playbackStartTime = 0;    // g_frameScheduler time at which the playback started
+static int g_numDrawCalls = 0;            // shape nodes drawn by the last frame
 
 ///////////////// END OF G L O B A L S //////////////////////////////////////////////////
 
 // Fur simulations
 
 
-// Specifying shell geometries based on g_tipPos, g_furHeight, and g_numShells.
+// Upload the hair tips of g_furSimulationThread for the shells. The shells
+// themselves are extruded by the bunny-shell vertex shader from the base mesh
+// in g_bunnyShellGeometry, using g_furHeight, g_shellLevel and these tips.
 // You need to call this function whenver the shell needs to be updated
 static void updateShellGeometry() {
 
-    for (int i = 0; i < g_numShells; ++i) {
-        // base mesh object
-        Mesh bunnyBaseMesh(g_bunnyMesh);
-
-        RigTForm invBunnyFrame = inv(getPathAccumRbt(g_world, g_bunnyNode));     // used to bring hair tip, velocity in world frame to object frame
-
-        // TASK 3 TODO. each shell has slightly different offset for curvy hair!
-        // translate all vertices by proper offset
-
-        
+    // bring the hair tips from world frame to object frame
+    const RigTFormf invBunnyFrame(inv(getPathAccumRbt(g_world, g_bunnyNode)));
+    const std::vector<Cvec3f>& tips = g_furSimulationThread.getTips();
+    g_tipPosObject.resize(tips.size());
+    transformPoints(invBunnyFrame, &tips[0], &g_tipPosObject[0], tips.size());
 
-        for (int j = 0; j < bunnyBaseMesh.getNumVertices(); ++j) {
-            Cvec3 p = bunnyBaseMesh.getVertex(j).getPosition();    // root of the hair in object frame
-            Cvec3 tip = Cvec3(invBunnyFrame * Cvec4(g_tipPos[j], 1.0));    // tip of the hair in object frame
-            Cvec3 n = bunnyBaseMesh.getVertex(j).getNormal() * (g_furHeight / static_cast<float>(g_numShells));    // scaled unit normal in object frame
-            Cvec3 d = (tip - p - n * g_numShells) * (2 / static_cast<float>(g_numShells * (g_numShells - 1)));    // constant displacement vector for curvy hair
-            Cvec3 offset = n * i + d * ((i * (i - 1)) / static_cast<float>(2));    // offset vector for each vertex in each shell
-            bunnyBaseMesh.getVertex(j).setPosition(p + offset);
+    g_shellNeedsUpdate = false;
+    g_numTipUploads = 0;
+
+    // the shell base mesh has one vertex per triangle corner, each needs the tip of its mesh vertex
+    const int numCorners = g_shellCornerVertex.size();
+    const std::vector<Cvec3f>& uploadTips = g_tipMotion.getReference();
+    if (g_tipMotion.update(&g_tipPosObject[0], g_tipPosObject.size()) == 0 && g_bunnyShellTipVbo->length() == numCorners)
+        return;
+
+    g_shellCornerTips.resize(numCorners);
+    if (g_bunnyShellTipVbo->length() != numCorners) {
+        for (int k = 0; k < numCorners; ++k) {
+            g_shellCornerTips[k] = uploadTips[g_shellCornerVertex[k]];
         }
+        g_bunnyShellTipVbo->upload(&g_shellCornerTips[0], numCorners, true);
+        g_numTipUploads = 1;
+        return;
+    }
 
-        // initialize vector for holding VertexPNX objects
-        std::vector<VertexPNX> vtx;
-
-        // Iterate over faces, put associated vertex & normal in the vector
-        for (int k = 0; k < bunnyBaseMesh.getNumFaces(); ++k) {
-            Mesh::Face face = bunnyBaseMesh.getFace(k);
-
-            // push triangle parameters - position, normal, and texture coordinate (simply unit isosceles triangle)
-            vtx.push_back(VertexPNX(face.getVertex(0).getPosition(), face.getVertex(0).getNormal(), Cvec2(0.0, 0.0)));
-            vtx.push_back(VertexPNX(face.getVertex(1).getPosition(), face.getVertex(1).getNormal(), Cvec2(g_hairyness, 0.0)));
-            vtx.push_back(VertexPNX(face.getVertex(2).getPosition(), face.getVertex(2).getNormal(), Cvec2(0.0, g_hairyness)));
+    // upload the runs of corners whose tip moved, runs separated by small gaps are merged
+    int runBegin = -1, runEnd = -1;
+    for (int k = 0; k <= numCorners; ++k) {
+        const bool moved = k < numCorners && g_tipMotion.hasMoved(g_shellCornerVertex[k]);
+        if (moved) {
+            g_shellCornerTips[k] = uploadTips[g_shellCornerVertex[k]];
+            if (runBegin >= 0 && k - runEnd <= g_tipUploadMergeGap) {
+                // clean corners in the gap still hold their uploaded tips
+                runEnd = k + 1;
+                continue;
+            }
+        }
+        if (runBegin >= 0 && (moved || k == numCorners)) {
+            g_bunnyShellTipVbo->uploadRange(&g_shellCornerTips[runBegin], runBegin, runEnd - runBegin);
+            g_numTipUploads++;
+            runBegin = -1;
+        }
+        if (moved) {
+            runBegin = k;
+            runEnd = k + 1;
         }
-
-        int vbLen = vtx.size();
-        g_bunnyShellGeometries[i]->upload(&vtx[0], vbLen);
     }
-
-    g_shellNeedsUpdate = false;
 }
 
 
-// New glut timer call back that perform dynamics simulation
-// every g_simulationsPerSecond times per second
-static void hairsSimulationCallback(int dontCare) {
-    
-    // NOTE! 
-    // All calculations are done in wobject frame
-    // and then converted to world frame
-
-    // get object frame of bunny in the scene
-    RigTForm bunnyFrame = getPathAccumRbt(g_world, g_bunnyNode);
-
-    for (int step = 0; step < g_numStepsPerFrame; ++step) {
-        for (int i = 0; i < g_tipPos.size(); ++i) {
-
-            // Step 0. Initialize variables
-            Cvec3 vertexPos = Cvec3(bunnyFrame * Cvec4(g_bunnyMesh.getVertex(i).getPosition(), 1.0));    // p    (world frame)
-            Cvec3 straightTip = Cvec3(bunnyFrame * Cvec4(g_bunnyMesh.getVertex(i).getPosition() + g_bunnyMesh.getVertex(i).getNormal() * g_furHeight, 1.0));    // s    (world frame)
-            Cvec3 hairTip = g_tipPos[i];    // t    (world frame)
-            Cvec3 gravity = g_gravity;    // g    (world frame)
-
-            // Step 1. Calculate net force on a fur
-            Cvec3 netForce = gravity + (straightTip - hairTip) * g_stiffness;
-
-            // Step 2. Update tip position
-            g_tipPos[i] += g_tipVelocity[i] * g_timeStep;
-
-            // Step 3. Apply constraint on tip position
-            g_tipPos[i] = vertexPos + normalize(g_tipPos[i] - vertexPos) * g_furHeight;
-
-            // Step 4. Update velocity
-            g_tipVelocity[i] = (g_tipVelocity[i] + netForce * g_timeStep) * g_damping;
-        }
-    }
+// Simulation parameters from the globals, in single precision, for integrator
+// running numSteps steps per frame. The steps cover the time of g_numStepsPerFrame
+// steps of g_timeStep, and g_damping is rescaled to give the same damping over that time.
+static FurSimulation::Params getFurParams(FurSimulation::Integrator integrator, int numSteps) {
+    const double stepScale = g_numStepsPerFrame / numSteps;
+    FurSimulation::Params params;
+    params.integrator = integrator;
+    params.gravity = g_gravity;
+    params.stiffness = g_stiffness;
+    params.damping = std::pow(g_damping, stepScale);
+    params.timeStep = g_timeStep * stepScale;
+    params.furHeight = g_furHeight;
+    params.numSteps = numSteps;
+    params.sleepSpeed = g_sleepSpeed;
+    params.sleepForce = g_sleepForce;
+    params.collisionMargin = g_furCollisionMargin;
+    return params;
+}
 
-    g_shellNeedsUpdate = true;
+// Simulation parameters for the current g_furIntegrator
+static FurSimulation::Params getFurParams() {
+    if (g_furIntegrator == FurSimulation::VERLET)
+        return getFurParams(FurSimulation::VERLET, g_verletStepsPerFrame);
+    return getFurParams(FurSimulation::EXPLICIT, static_cast<int>(g_numStepsPerFrame));
+}
 
-    // schedule this to get called again
-    glutTimerFunc(1000 / g_simulationsPerSecond, hairsSimulationCallback, 0);
-    glutPostRedisplay(); // signal redisplaying
+// Current bunny frame and parameters for g_furSimulationThread, which advances
+// the dynamics by one frame (g_numStepsPerFrame steps of g_timeStep, or the
+// same time in g_verletStepsPerFrame steps) g_simulationsPerSecond times per second
+static FurSimulationThread::Input getFurInput() {
+    FurSimulationThread::Input input;
+    input.frame = RigTFormf(getPathAccumRbt(g_world, g_bunnyNode));
+    input.params = getFurParams();
+    return input;
 }
 
 // New function that initialize the dynamics simulation
 static void initSimulation() {
-    g_tipPos.resize(g_bunnyMesh.getNumVertices(), Cvec3(0));
-    g_tipVelocity = g_tipPos;
-
-    // get object frame of bunny in the scene
-    RigTForm bunnyFrame = getPathAccumRbt(g_world, g_bunnyNode);
-
-    // TASK 1 TODO: initialize g_tipPos to "at-rest" hair tips in world coordinates
-    for (int i = 0; i < g_bunnyMesh.getNumVertices(); ++i) {
-        Cvec4 vertexTip = Cvec4(g_bunnyMesh.getVertex(i).getPosition() + g_bunnyMesh.getVertex(i).getNormal() * g_furHeight, 1);    // NOTE! object coordinate
-        vertexTip = bunnyFrame * vertexTip;    // convert to world frame
-        g_tipPos[i] = Cvec3(vertexTip);
-    }
+    // hair tips start "at-rest" in world coordinates
+    const FurSimulationThread::Input input = getFurInput();
+    g_furSimulation.init(g_bunnyMesh, input.frame, input.params.furHeight);
+    g_furSimulation.setCollider(&g_bunnySdf);
 
     // Starts hair tip simulation
-    hairsSimulationCallback(0);
+    g_furSimulationThread.start(input);
+    g_shellNeedsUpdate = g_furSimulationThread.acquireTips();
 }
  
 //! Geometry primitives initialization
 static void initGround() {
-    int ibLen, vbLen;
-    getPlaneVbIbLen(vbLen, ibLen);
-
-    // Temporary storage for cube geometry
-    std::vector<VertexPNTBX> vtx(vbLen);
-    std::vector<unsigned short> idx(ibLen);
-
-    makePlane(g_groundSize * 2, vtx.begin(), idx.begin());
-    g_ground.reset(new SimpleIndexedGeometryPNTBX(&vtx[0], &idx[0], vbLen, ibLen));
+    // Plane vertices and indices are computed at compile time
+    static constexpr GeometryTable<VertexPNTBX, PLANE_VB_LEN, PLANE_IB_LEN> plane =
+        makePlaneTable<VertexPNTBX>(g_groundSize * 2);
+    g_ground.reset(new SimpleIndexedGeometryPNTBX(plane.vtx, plane.idx, PLANE_VB_LEN, PLANE_IB_LEN));
 }
 
 static void initCubes() {
-  int ibLen, vbLen;
-  getCubeVbIbLen(vbLen, ibLen);
-
-  // Temporary storage for cube geometry
-  std::vector<VertexPNTBX> vtx(vbLen);
-  std::vector<unsigned short> idx(ibLen);
-
-  // create the first cube
-  makeCube(1, vtx.begin(), idx.begin());
-  g_cube.reset(new SimpleIndexedGeometryPNTBX(&vtx[0], &idx[0], vbLen, ibLen));
+  // Unit cube vertices and indices are computed at compile time
+  static constexpr GeometryTable<VertexPNTBX, CUBE_VB_LEN, CUBE_IB_LEN> cube = makeCubeTable<VertexPNTBX>(1);
+  g_cube.reset(new SimpleIndexedGeometryPNTBX(cube.vtx, cube.idx, CUBE_VB_LEN, CUBE_IB_LEN));
 }
 
 static void initSpheres() {
@@ -328,6 +362,32 @@ static Matrix4 makeProjectionMatrix() {
            g_frustNear, g_frustFar);
 }
 
+// Pick the number of shell layers from the on-screen size of the fur: about
+// g_shellsPerFurPixel layers per pixel of fur height where the bunny is
+// nearest to the eye, between g_minShells and g_numShells. The level is
+// continuous, the shaders spread the layers over the hair accordingly and
+// fade in the outermost one. Tip motion below half a pixel is not uploaded.
+static void updateShellLod(const RigTForm& invEyeRbt) {
+    const Cvec3 eyeCenter = Cvec3(invEyeRbt * getPathAccumRbt(g_world, g_bunnyNode) * Cvec4(g_bunnyCenter, 1));
+    const double nearestZ = eyeCenter[2] + g_bunnyRadius + g_furHeight;
+    double threshold = g_tipMotionThreshold;
+    if (nearestZ > -CS175_EPS) {
+        // the eye is inside the fur
+        g_shellLevel = g_numShells;
+    }
+    else {
+        const double pixelSize = getScreenToEyeScale(nearestZ, g_frustFovY, g_windowHeight);
+        g_shellLevel = std::max<double>(g_minShells, std::min<double>(g_numShells, g_shellsPerFurPixel * g_furHeight / pixelSize));
+        threshold = std::max(threshold, 0.5 * pixelSize);
+    }
+
+    // tips left behind by a coarser threshold have to be checked again, even if the fur sleeps
+    if (threshold < g_tipUploadThreshold)
+        g_shellNeedsUpdate = true;
+    g_tipUploadThreshold = threshold;
+    g_tipMotion.setThreshold(threshold);
+}
+
 static void drawStuff(bool picking) {
 
     Uniforms uniforms;
@@ -346,6 +406,14 @@ static void drawStuff(bool picking) {
     uniforms.put("uLight", eyeLight1);
     uniforms.put("uLight2", eyeLight2);
 
+    // shell extrusion parameters for the bunny-shell vertex shader
+    updateShellLod(invEyeRbt);
+    g_bunnyShellGeometry->instances(static_cast<int>(std::ceil(g_shellLevel)));
+    uniforms.put("uFurHeight", static_cast<float>(g_furHeight));
+    uniforms.put("uNumShells", static_cast<float>(g_shellLevel));
+    uniforms.put("uLayerOpacity", static_cast<float>(g_numShells / g_shellLevel));
+    uniforms.put("uHairyness", static_cast<float>(g_hairyness));
+
     if (g_shellNeedsUpdate) {
         updateShellGeometry();
     }
@@ -353,6 +421,7 @@ static void drawStuff(bool picking) {
     if (!picking) {
         Drawer drawer(invEyeRbt, uniforms);
         g_world->accept(drawer);
+        g_numDrawCalls = drawer.getNumDrawCalls();
 
         RigTForm MVRigTForm;
         if (!g_isWorldSky) {
@@ -367,9 +436,9 @@ static void drawStuff(bool picking) {
                     g_arcballScale = getScreenToEyeScale(z, g_frustFovY, g_windowHeight);
                 }
 
-                Matrix4 MVM = rigTFormToMatrix(MVRigTForm);
+                AffineMatrix MVM = rigTFormToAffineMatrix(MVRigTForm);
                 double scale = g_arcballScale * g_arcballScreenRadius;
-                Matrix4 scale_mat = Matrix4::makeScale(Cvec3(scale, scale, scale));
+                AffineMatrix scale_mat = AffineMatrix::makeScale(Cvec3(scale, scale, scale));
 
                 MVM *= scale_mat;
                 sendModelViewNormalMatrix(uniforms, MVM, normalMatrix(MVM));
@@ -387,9 +456,9 @@ static void drawStuff(bool picking) {
                 g_arcballScale = getScreenToEyeScale(z, g_frustFovY, g_windowHeight);
             }
 
-            Matrix4 MVM = rigTFormToMatrix(MVRigTForm);
+            AffineMatrix MVM = rigTFormToAffineMatrix(MVRigTForm);
             double scale = g_arcballScale * g_arcballScreenRadius;
-            Matrix4 scale_mat = Matrix4::makeScale(Cvec3(scale, scale, scale));
+            AffineMatrix scale_mat = AffineMatrix::makeScale(Cvec3(scale, scale, scale));
 
             MVM *= scale_mat;
             sendModelViewNormalMatrix(uniforms, MVM, normalMatrix(MVM));
@@ -415,38 +484,79 @@ static void drawStuff(bool picking) {
 }
 
 /* GLUT callbacks */
-static void animateTimerCallback(int ms) {
+// Set the scene to the animation pose ms milliseconds into the playback
+static void animateAt(int ms) {
     if (g_playing) {
-        float t = static_cast<float>(ms) / static_cast<float>(g_msBetweenKeyFrames);
-        Animation::Frame interFrame = Animation::Frame();
-        bool endReached = g_keyframes.interpolateKeyframes(t, interFrame);
-
-        if (!endReached) {
-            // update current scene using interpolated frame
-            setSgRbtNodes(g_sceneRbtVector, interFrame);
-            glutPostRedisplay();
-
-            // register another timer callback
-            glutTimerFunc(1000 / g_animationFramesPerSecond,
-                animateTimerCallback,
-                ms + 1000 / g_animationFramesPerSecond);
+        bool endReached;
+        if (g_streaming) {
+            float t = static_cast<float>(ms) / static_cast<float>(g_msBetweenKeyFrames);
+            static Animation::Frame streamFrame;    // reused between callbacks
+            endReached = g_keyframeStream.interpolateKeyframes(t, streamFrame);
+            if (!endReached) {
+                setSgRbtNodes(g_sceneRbtVector, streamFrame);
+            }
+        }
+        else if (g_useBakedAnimation
+            && g_bakedAnimation.isValidFor(g_keyframes, 1000 / g_animationFramesPerSecond, g_msBetweenKeyFrames)) {
+            // copy the pre-sampled pose, held for 1000 / g_animationFramesPerSecond ms
+            const RigTForm* pose = g_bakedAnimation.poseAt(ms);
+            endReached = pose == NULL;
+            if (!endReached) {
+                setSgRbtNodes(g_sceneRbtVector, pose);
+            }
         }
         else {
+            float t = static_cast<float>(ms) / static_cast<float>(g_msBetweenKeyFrames);
+            static Animation::Frame interFrame;    // reused between callbacks
+            endReached = g_keyframes.interpolateKeyframes(t, interFrame);
+            if (!endReached) {
+                // update current scene using interpolated frame
+                setSgRbtNodes(g_sceneRbtVector, interFrame);
+            }
+        }
+
+        if (endReached && g_streaming) {
+            std::cout << "Streaming playback is finished...\n";
+            g_keyframeStream.close();
+            g_streaming = false;
+            g_playing = false;
+        }
+        else if (endReached) {
             std::cout << "Animation playback is finished...\n";
             // when reached the end of keyframes, set (n-1)th frame
             // as the current frame
-            std::list<Animation::Frame>::iterator last = --g_keyframes.end();
+            Animation::KeyframeList::iterator last = --g_keyframes.end();
             g_keyframes.setCurrentKeyframeAs(last);
             g_playing = false;
         }
     }
 }
 
+// Frame loop: samples the animation at wall-clock time, exchanges the bunny
+// frame and the hair tips with the simulation thread and redraws unless the
+// loop is running behind
+static void frameTimerCallback(int dontCare) {
+    const FrameScheduler::Tick tick = g_frameScheduler.tick();
+
+    g_furSimulationThread.setInput(getFurInput());
+    if (g_furSimulationThread.acquireTips()) {
+        g_shellNeedsUpdate = true;
+    }
+
+    if (g_playing) {
+        animateAt(static_cast<int>(1000 * (tick.time - g_playbackStartTime)));
+    }
+
+    if (tick.render) {
+        glutPostRedisplay();
+    }
+
+    glutTimerFunc(g_frameScheduler.msUntilNextFrame(), frameTimerCallback, 0);
+}
+
 static void display() {
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);                   // clear framebuffer color&depth
 
-  updateShellGeometry();
-
   drawStuff(g_isPicking);
 
   if (!g_isPicking) {
@@ -694,6 +804,15 @@ static void keyboard(const unsigned char key, const int x, const int y) {
             << "v\t\tCycle view\n"
             << "d\t\tDescribe current eye, object matrices\n"
             << "r\t\tReset the position of current object\n"
+            << "c\t\tToggle linear / Catmull-Rom keyframe interpolation\n"
+            << "[ ]\t\tMove the current and following keyframes earlier / later\n"
+            << "b\t\tToggle playback from a pre-baked animation\n"
+            << "T\t\tPrint frame timing statistics\n"
+            << "V\t\tToggle explicit / Verlet fur integrator\n"
+            << "W\t\tWrite keyframes to keyframe.kfb (binary)\n"
+            << "Z\t\tWrite keyframes to keyframe.kfb (compressed)\n"
+            << "I\t\tRead keyframes from keyframe.kfb (binary)\n"
+            << "S\t\tPlay keyframe.kfb streamed from the disk\n"
             << "drag left mouse to rotate\n" << endl;
         break;
 
@@ -759,17 +878,92 @@ static void keyboard(const unsigned char key, const int x, const int y) {
                 break;
             }
             g_playing = true;
-            animateTimerCallback(0);
+            if (g_useBakedAnimation) {
+                // until the bake is ready, frames are interpolated on the fly
+                g_bakedAnimation.bakeAsync(g_keyframes, 1000 / g_animationFramesPerSecond, g_msBetweenKeyFrames);
+            }
+            g_playbackStartTime = g_frameScheduler.time();
+            animateAt(0);
+            glutPostRedisplay();
         }
         else {
             // stop playing animation
             g_playing = false;
+            if (g_streaming) {
+                g_keyframeStream.close();
+                g_streaming = false;
+            }
             g_keyframes.sendCurrentKeyframeToScene(g_sceneRbtVector);
             glutPostRedisplay();
         }
         break;
     }
 
+    case 'S':
+    {
+        // play keyframe.kfb directly from the disk
+        if (g_playing) {
+            std::cerr << "Stop the current playback first!\n";
+            break;
+        }
+        std::string filename = "keyframe.kfb";
+        if (!g_keyframeStream.open(filename)) {
+            break;
+        }
+        if (g_keyframeStream.numRbts() != static_cast<int>(g_sceneRbtVector.size()) || g_keyframeStream.size() < 4) {
+            std::cerr << "The keyframes in " << filename << " do not fit the scene!\n";
+            g_keyframeStream.close();
+            break;
+        }
+        std::cout << "Streaming " << g_keyframeStream.size() << " keyframes from " << filename << "...\n";
+        g_keyframeStream.setInterpolationMode(g_keyframes.getInterpolationMode());
+        g_streaming = true;
+        g_playing = true;
+        g_playbackStartTime = g_frameScheduler.time();
+        animateAt(0);
+        glutPostRedisplay();
+        break;
+    }
+
+    case 'T':
+        // print and reset the frame timing statistics
+        g_frameScheduler.printStats();
+        g_frameScheduler.resetStats();
+        g_furSimulationThread.printStats();
+        cout << "Scene graph draw calls per frame: " << g_numDrawCalls << "\n";
+        cout << "Hair tip uploads in the last shell update: " << g_numTipUploads << "\n";
+        cout << "Fur shell layers: " << g_shellLevel << " of " << g_numShells << "\n";
+        break;
+
+    case 'V':
+        // switch the fur integrator, picked up by the simulation thread with the next input
+        if (g_furIntegrator == FurSimulation::EXPLICIT) {
+            g_furIntegrator = FurSimulation::VERLET;
+            cout << "Fur uses the Verlet integrator (" << g_verletStepsPerFrame << " steps per frame)\n";
+        }
+        else {
+            g_furIntegrator = FurSimulation::EXPLICIT;
+            cout << "Fur uses the explicit integrator (" << g_numStepsPerFrame << " steps per frame)\n";
+        }
+        break;
+
+    case 'b':
+    {
+        // toggle playback from the baked animation
+        g_useBakedAnimation = !g_useBakedAnimation;
+        if (g_useBakedAnimation) {
+            std::cout << "Playing back from baked animation\n";
+            if (g_keyframes.size() >= 4) {
+                g_bakedAnimation.bakeAsync(g_keyframes, 1000 / g_animationFramesPerSecond, g_msBetweenKeyFrames);
+            }
+        }
+        else {
+            std::cout << "Interpolating keyframes during playback\n";
+            g_bakedAnimation.clear();
+        }
+        break;
+    }
+
     case '+':
     {
         if (g_msBetweenKeyFrames >= 200) {
@@ -853,6 +1047,30 @@ static void keyboard(const unsigned char key, const int x, const int y) {
         break;
     }
 
+    case '[':
+    case ']':
+    {
+        // shorten / lengthen the time before the current keyframe by a quarter of a segment
+        if (g_keyframes.shiftCurrentKeyframe(key == ']' ? 0.25 : -0.25)) {
+            std::cout << "Current keyframe is now at time " << g_keyframes.getCurrentKeyframeTime() << "\n";
+        }
+        break;
+    }
+
+    case 'c':
+    {
+        // toggle between linear and Catmull-Rom interpolation
+        if (g_keyframes.getInterpolationMode() == Animation::LINEAR) {
+            g_keyframes.setInterpolationMode(Animation::CATMULL_ROM);
+            std::cout << "Using Catmull-Rom interpolation\n";
+        }
+        else {
+            g_keyframes.setInterpolationMode(Animation::LINEAR);
+            std::cout << "Using linear interpolation\n";
+        }
+        break;
+    }
+
     case 'w':
     {
         // write current keyframe list to a file
@@ -870,6 +1088,33 @@ static void keyboard(const unsigned char key, const int x, const int y) {
         g_keyframes.importKeyframeList(filename);
         break;
     }
+
+    case 'W':
+    {
+        // write current keyframe list to a binary file
+        std::cout << "Writing current keyframe list (binary)...\n";
+        std::string filename = "keyframe.kfb";
+        g_keyframes.exportKeyframeList(filename, Animation::BINARY_FORMAT);
+        break;
+    }
+
+    case 'Z':
+    {
+        // write current keyframe list to a compressed binary file
+        std::cout << "Writing current keyframe list (compressed)...\n";
+        std::string filename = "keyframe.kfb";
+        g_keyframes.exportKeyframeList(filename, Animation::COMPRESSED_FORMAT);
+        break;
+    }
+
+    case 'I':
+    {
+        // read keyframe data from a binary file
+        std::cout << "Reading keyframe list from the binary file...\n";
+        std::string filename = "keyframe.kfb";
+        g_keyframes.importKeyframeList(filename);
+        break;
+    }
     }
 }
 
@@ -980,35 +1225,22 @@ static void initMaterials() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
-    // eachy layer of the shell uses a different material, though the materials will share the
-    // same shader files and some common uniforms. hence we create a prototype here, and will
-    // copy from the prototype later
-    Material bunnyShellMatPrototype("./shaders/bunny-shell-gl3.vshader", "./shaders/bunny-shell-gl3.fshader");
-    bunnyShellMatPrototype.getUniforms().put("uTexShell", shellTexture);
-    bunnyShellMatPrototype.getRenderStates()
+    // all layers of the shell share one material, the vertex shader derives the
+    // layer and its exponent for blending transparency from the instance index
+    g_bunnyShellMat.reset(new Material("./shaders/bunny-shell-gl3.vshader", "./shaders/bunny-shell-gl3.fshader"));
+    g_bunnyShellMat->getUniforms().put("uTexShell", shellTexture);
+    g_bunnyShellMat->getRenderStates()
         .blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA) // set blending mode
         .enable(GL_BLEND) // enable blending
         .disable(GL_CULL_FACE); // disable culling
-
-    // allocate array of materials
-    g_bunnyShellMats.resize(g_numShells);
-    for (int i = 0; i < g_numShells; ++i) {
-        g_bunnyShellMats[i].reset(new Material(bunnyShellMatPrototype)); // copy from the prototype
-        // but set a different exponent for blending transparency
-        g_bunnyShellMats[i]->getUniforms().put("uAlphaExponent", 2.f + 5.f * float(i + 1) / g_numShells);
-    }
 }
 
-static void initBunnyMeshes() {
+// Load g_bunnyMesh and give it smooth vertex normals, needs no OpenGL context
+static void loadBunnyMesh() {
 
     // load mesh file
     g_bunnyMesh.load("bunny.mesh");
 
-    // reset geometry
-    g_bunnyGeometry.reset(new SimpleGeometryPN());
-
-    std::vector<VertexPN> vtx;
-
     // Bunny geometry should use smooth vector by default
     std::vector<int> vertexValence(g_bunnyMesh.getNumVertices());
 
@@ -1044,6 +1276,43 @@ static void initBunnyMeshes() {
         }
         currentVertex.setNormal(currentVertexNormal);
     }
+}
+
+// Sample the signed distance field of g_bunnyMesh into g_bunnySdf, spread over pool.
+// Returns the build time in seconds.
+static double buildBunnySdf(ThreadPool& pool) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    g_bunnySdf.build(g_bunnyMesh, g_sdfResolution, g_sdfPadding, pool);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void initBunnyMeshes() {
+    loadBunnyMesh();
+
+    // collider of the fur, built before the simulation thread takes over g_threadPool
+    const double sdfSeconds = buildBunnySdf(g_threadPool);
+    cout << "Bunny distance field: " << g_bunnySdf.getDim(0) << "x" << g_bunnySdf.getDim(1) << "x"
+         << g_bunnySdf.getDim(2) << " in " << sdfSeconds * 1000 << " ms" << endl;
+
+    // bounding sphere around the center of the bounding box, for the shell LOD
+    Cvec3 boxMin = g_bunnyMesh.getVertex(0).getPosition(), boxMax = boxMin;
+    for (int i = 1; i < g_bunnyMesh.getNumVertices(); ++i) {
+        const Cvec3 p = g_bunnyMesh.getVertex(i).getPosition();
+        for (int c = 0; c < 3; ++c) {
+            boxMin[c] = std::min(boxMin[c], p[c]);
+            boxMax[c] = std::max(boxMax[c], p[c]);
+        }
+    }
+    g_bunnyCenter = (boxMin + boxMax) * 0.5;
+    g_bunnyRadius = 0;
+    for (int i = 0; i < g_bunnyMesh.getNumVertices(); ++i) {
+        g_bunnyRadius = std::max(g_bunnyRadius, norm(g_bunnyMesh.getVertex(i).getPosition() - g_bunnyCenter));
+    }
+
+    // reset geometry
+    g_bunnyGeometry.reset(new SimpleGeometryPN());
+
+    std::vector<VertexPN> vtx;
 
     // Iterate over faces, put associated vertex & normal in the vector
     for (int i = 0; i < g_bunnyMesh.getNumFaces(); ++i) {
@@ -1059,11 +1328,25 @@ static void initBunnyMeshes() {
 
     g_bunnyGeometry->upload(&vtx[0], vbLen);
 
-    // Now allocate array of SimpleGeometryPNX to for shells, one per layer
-    g_bunnyShellGeometries.resize(g_numShells);
-    for (int i = 0; i < g_numShells; ++i) {
-        g_bunnyShellGeometries[i].reset(new SimpleGeometryPNX());
+    // The shell base mesh is uploaded once: one vertex per triangle corner with the
+    // hair root, the normal and a unit isosceles triangle as texture coordinates
+    // (scaled by uHairyness in the shader). The hair tips go into a separate vbo.
+    std::vector<VertexPNX> shellVtx;
+    g_shellCornerVertex.clear();
+    for (int i = 0; i < g_bunnyMesh.getNumFaces(); ++i) {
+        Mesh::Face face = g_bunnyMesh.getFace(i);
+        const Cvec2 texCoords[3] = { Cvec2(0, 0), Cvec2(1, 0), Cvec2(0, 1) };
+        for (int j = 0; j < 3; ++j) {
+            shellVtx.push_back(VertexPNX(face.getVertex(j).getPosition(), face.getVertex(j).getNormal(), texCoords[j]));
+            g_shellCornerVertex.push_back(face.getVertex(j).getIndex());
+        }
     }
+
+    std::shared_ptr<FormattedVbo> shellVbo(new FormattedVbo(VertexPNX::FORMAT));
+    shellVbo->upload(&shellVtx[0], shellVtx.size());
+    g_bunnyShellTipVbo.reset(new FormattedVbo(g_hairTipFormat));
+    g_bunnyShellGeometry.reset(new BufferObjectGeometry());
+    g_bunnyShellGeometry->wire(shellVbo).wire(g_bunnyShellTipVbo);    // instances set per frame by drawStuff
 }
 
 static void initGeometry() {
@@ -1177,14 +1460,9 @@ static void initScene() {
     g_bunnyNode->addChild(shared_ptr<MyShapeNode>(
         new MyShapeNode(g_bunnyGeometry, g_bunnyMat)));
 
-    // add each shell as shape node
-    for (int i = 0; i < g_numShells; ++i) {
-        g_bunnyNode->addChild(shared_ptr<MyShapeNode>(
-            new MyShapeNode(g_bunnyShellGeometries[i], g_bunnyShellMats[i])));
-    }
-
-    // from this point, calling g_bunnyShellGeometries[i]->reset(...) will change the
-    // geometry of the ith layer of shell that gets drawn
+    // add the shells as one shape node, drawing one instance of the shell geometry per layer
+    g_bunnyNode->addChild(shared_ptr<MyShapeNode>(
+        new MyShapeNode(g_bunnyShellGeometry, g_bunnyShellMat)));
 
     g_robot1Node.reset(new SgRbtNode(RigTForm(Cvec3(-10, 1, 0))));
     g_robot2Node.reset(new SgRbtNode(RigTForm(Cvec3(10, 1, 0))));
@@ -1209,8 +1487,372 @@ static void initScene() {
     dumpSgRbtNodes(g_world, g_sceneRbtVector);
 }
 
+// Headless benchmark of the fur simulation (asst6 -benchfur [numFrames [numThreads]]):
+// runs numFrames simulation frames on the bunny while it spins and reports
+// the throughput in tips per second. numThreads <= 0 uses one thread per core.
+// The reference is a converged Verlet run with CONVERGED_STEPS steps per frame;
+// the explicit integrator with g_numStepsPerFrame steps and both integrators
+// with g_verletStepsPerFrame steps report their drift (tip distance to the
+// reference after each frame), and so does a run colliding with g_bunnySdf.
+static void benchmarkFur(int numFrames, int numThreads) {
+    static const int CONVERGED_STEPS = 200;
+
+    loadBunnyMesh();
+
+    struct Run {
+        const char* name;
+        FurSimulation::Params params;
+        bool collide;
+        std::shared_ptr<FurSimulation> simulation;
+        double seconds;
+        double sumDrift, maxDrift;
+
+        Run(const char* name, const FurSimulation::Params& params, bool collide)
+            : name(name), params(params), collide(collide), seconds(0), sumDrift(0), maxDrift(0) {}
+    };
+    Run runs[] = {
+        Run("converged verlet", getFurParams(FurSimulation::VERLET, CONVERGED_STEPS), false),
+        Run("explicit", getFurParams(FurSimulation::EXPLICIT, static_cast<int>(g_numStepsPerFrame)), false),
+        Run("explicit", getFurParams(FurSimulation::EXPLICIT, g_verletStepsPerFrame), false),
+        Run("verlet", getFurParams(FurSimulation::VERLET, g_verletStepsPerFrame), false),
+        Run("verlet + collision", getFurParams(FurSimulation::VERLET, g_verletStepsPerFrame), true),
+    };
+    const int numRuns = sizeof(runs) / sizeof(runs[0]);
+
+    ThreadPool pool(numThreads);
+    const double sdfSeconds = buildBunnySdf(pool);
+    for (int r = 0; r < numRuns; ++r) {
+        runs[r].params.sleepSpeed = 0;    // a spinning bunny never settles, skip the checks
+        runs[r].simulation.reset(new FurSimulation(pool));
+        runs[r].simulation->init(g_bunnyMesh, RigTFormf(), runs[r].params.furHeight);
+        if (runs[r].collide)
+            runs[r].simulation->setCollider(&g_bunnySdf);
+    }
+
+    const FurSimulation& reference = *runs[0].simulation;
+    const int numTips = reference.getNumTips();
+    double numDriftSamples = 0;
+    for (int frame = 0; frame < numFrames; ++frame) {
+        for (int r = 0; r < numRuns; ++r) {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            runs[r].simulation->simulate(RigTFormf::makeYRotation(frame), runs[r].params);
+            runs[r].seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            for (int i = 0; i < numTips; ++i) {
+                const Cvec3f referenceTip = reference.getTip(i);
+                if (r == 0)
+                    numDriftSamples++;
+                const double drift = norm(runs[r].simulation->getTip(i) - referenceTip);
+                runs[r].sumDrift += drift;
+                // also catches NaN tips of a diverging run
+                if (!(drift <= runs[r].maxDrift))
+                    runs[r].maxDrift = drift;
+            }
+        }
+    }
+
+    cout << "benchfur: " << numTips << " tips, " << numFrames << " frames on "
+         << reference.getNumThreads() << " threads, fur height " << g_furHeight << endl;
+    cout << "  distance field " << g_bunnySdf.getDim(0) << "x" << g_bunnySdf.getDim(1) << "x"
+         << g_bunnySdf.getDim(2) << " built in " << sdfSeconds << " s" << endl;
+    for (int r = 0; r < numRuns; ++r) {
+        const double numTipSteps = double(numTips) * runs[r].params.numSteps * numFrames;
+        cout << "  " << runs[r].name << ", " << runs[r].params.numSteps << " steps per frame: "
+             << runs[r].seconds << " s, " << numTipSteps / runs[r].seconds << " tips/s, "
+             << numFrames / runs[r].seconds << " frames/s";
+        if (r > 0)
+            cout << ", drift avg. " << runs[r].sumDrift / numDriftSamples << " max. " << runs[r].maxDrift;
+        cout << endl;
+    }
+}
+
+// Headless benchmark of the animation system
+// (asst6 -benchanim [numCharacters [numNodes [numFrames [numThreads]]]]):
+// plays numCharacters looping characters of numNodes nodes each, every one with
+// its own copy of one random Catmull-Rom timeline and its own scene nodes, spread
+// over the timeline. Reports the time per evaluate() on numThreads threads
+// (<= 0: one per core) and on one thread, and whether both give the same poses.
+static void benchmarkAnimation(int numCharacters, int numNodes, int numFrames, int numThreads) {
+    std::mt19937 rng(175);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    Animation::KeyframeList timeline;
+    for (int k = 0; k < 8; ++k) {
+        Animation::Frame frame(numNodes);
+        for (int i = 0; i < numNodes; ++i) {
+            const Quat q = normalize(Quat(uniform(rng), uniform(rng), uniform(rng), uniform(rng)));
+            frame[i] = RigTForm(Cvec3(uniform(rng), uniform(rng), uniform(rng)), q);
+        }
+        timeline.addNewKeyframe(frame);
+    }
+    timeline.setInterpolationMode(Animation::CATMULL_ROM);
+
+    ThreadPool pool(numThreads), serialPool(1);
+    Animation::AnimationSystem system(pool), serial(serialPool);
+    for (int c = 0; c < numCharacters; ++c) {
+        Animation::SceneRbtVector nodes(numNodes);
+        for (int i = 0; i < numNodes; ++i) {
+            nodes[i].reset(new SgRbtNode());
+        }
+        const float phase = static_cast<float>(timeline.getEndTime() * c / numCharacters);
+        system.setTime(system.addCharacter(timeline, nodes, true), phase);
+        serial.setTime(serial.addCharacter(timeline, Animation::SceneRbtVector(), true), phase);
+    }
+
+    // one frame of g_animationFramesPerSecond, in keyframe time units
+    const float dt = (1000.f / g_animationFramesPerSecond) / g_msBetweenKeyFrames;
+    double sumMs = 0, sumSerialMs = 0;
+    for (int frame = 0; frame < numFrames; ++frame) {
+        system.advance(dt);
+        system.evaluate();
+        sumMs += system.getLastEvaluationMs();
+        serial.advance(dt);
+        serial.evaluate();
+        sumSerialMs += serial.getLastEvaluationMs();
+    }
+
+    bool identical = true;
+    for (int c = 0; c < numCharacters; ++c) {
+        const Animation::Frame& pose = system.getPose(c);
+        const Animation::Frame& serialPose = serial.getPose(c);
+        for (int i = 0; i < numNodes; ++i) {
+            const Cvec3 t = pose[i].getTranslation() - serialPose[i].getTranslation();
+            const Quat q = pose[i].getRotation() - serialPose[i].getRotation();
+            identical = identical && t[0] == 0 && t[1] == 0 && t[2] == 0
+                && q[0] == 0 && q[1] == 0 && q[2] == 0 && q[3] == 0;
+        }
+    }
+
+    cout << "benchanim: " << numCharacters << " characters x " << numNodes << " nodes, "
+         << numFrames << " frames" << endl;
+    cout << "  " << pool.numThreads() << " threads: avg. " << (numFrames > 0 ? sumMs / numFrames : 0.0)
+         << " ms per evaluate(), 1 thread: avg. " << (numFrames > 0 ? sumSerialMs / numFrames : 0.0)
+         << " ms, poses " << (identical ? "identical" : "DIFFERENT") << endl;
+    cout << "  last frame: ";
+    system.printStats();
+}
+
+// Self test of the compressed keyframe format (asst6 -testkeyframes): decompress
+// has to restore a compressed animation and reject truncated or corrupt streams
+// without crashing or allocating frames the data cannot hold, and compress has
+// to clamp non-finite translations.
+// Returns the number of failed checks.
+static int testKeyframeCompression() {
+    using namespace KeyframeCompression;
+    int numChecks = 0, numFailed = 0;
+    auto check = [&](bool passed, const char* what) {
+        numChecks++;
+        if (!passed) {
+            numFailed++;
+            cout << "  FAILED: " << what << endl;
+        }
+    };
+
+    // nodes moving on straight lines for the first half, which the key
+    // reduction mostly drops, and jittering for the second half
+    std::mt19937 rng(175);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    const int numFrames = 40, numRbts = 5;
+    std::vector<Frame> frames(numFrames, Frame(numRbts));
+    for (int i = 0; i < numRbts; ++i) {
+        const Cvec3 velocity(uniform(rng), uniform(rng), uniform(rng));
+        for (int f = 0; f < numFrames; ++f) {
+            const Cvec3 jitter = f < numFrames / 2 ? Cvec3() : Cvec3(uniform(rng), uniform(rng), uniform(rng)) * 0.1;
+            const Quat q = normalize(Quat(1 + uniform(rng), uniform(rng), uniform(rng), uniform(rng)));
+            frames[f][i] = RigTForm(velocity * (0.1 * f) + jitter, f < numFrames / 2 ? Quat() : q);
+        }
+    }
+    Settings settings;
+    settings.translationTolerance = 1e-3;
+    settings.rotationTolerance = 1e-3;
+    const Stream stream = compress(frames, settings);
+    const std::vector<unsigned char>& bytes = stream.bytes;
+
+    // the failures below are expected, keep their messages off the console
+    std::cerr.setstate(std::ios::failbit);
+
+    std::vector<Frame> out;
+    bool restored = decompress(stream, out) && static_cast<int>(out.size()) == numFrames;
+    for (int f = 0; restored && f < numFrames; ++f) {
+        restored = static_cast<int>(out[f].size()) == numRbts;
+        for (int i = 0; restored && i < numRbts; ++i) {
+            restored = norm(out[f][i].getTranslation() - frames[f][i].getTranslation())
+                <= settings.translationTolerance + settings.translationStep;
+        }
+    }
+    check(restored, "round trip");
+    check(stream.numKeys < static_cast<uint32_t>(numFrames), "key reduction");
+
+    bool truncatedRejected = true;
+    for (std::size_t size = 0; size < bytes.size(); ++size) {
+        truncatedRejected = truncatedRejected && !decompress(&bytes[0], size, numFrames, numRbts, stream.translationStep, out);
+    }
+    check(truncatedRejected, "truncated streams");
+
+    // the first key moved to frame 1, with one more frame so that the last key still ends the animation
+    std::vector<unsigned char> late(bytes);
+    late[0] = 1;
+    check(!decompress(&late[0], late.size(), numFrames + 1, numRbts, stream.translationStep, out), "first frame missing");
+
+    check(!decompress(&bytes[0], bytes.size(), 0xffffffffu, numRbts, stream.translationStep, out), "frame count too large");
+    check(!decompress(&bytes[0], bytes.size(), numFrames, 0x60000000u, stream.translationStep, out), "node count too large");
+
+    // any single flipped bit either is detected or decodes to whole frames
+    bool flipsHandled = true;
+    for (std::size_t b = 0; b < bytes.size() * 8; ++b) {
+        std::vector<unsigned char> corrupt(bytes);
+        corrupt[b / 8] ^= static_cast<unsigned char>(1 << (b % 8));
+        if (decompress(&corrupt[0], corrupt.size(), numFrames, numRbts, stream.translationStep, out)) {
+            flipsHandled = flipsHandled && static_cast<int>(out.size()) == numFrames;
+            for (int f = 0; flipsHandled && f < numFrames; ++f) {
+                flipsHandled = static_cast<int>(out[f].size()) == numRbts;
+            }
+        }
+    }
+    check(flipsHandled, "flipped bits");
+
+    // non-finite and huge translations are clamped by the quantization
+    std::vector<Frame> extreme(2, Frame(numRbts));
+    extreme[1][0] = RigTForm(Cvec3(std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::infinity(), -1e300));
+    extreme[1][1] = RigTForm(Cvec3(0.5, 0, 0));
+    const bool extremeRestored = decompress(compress(extreme, settings), out) && out.size() == 2
+        && out[1][0].getTranslation()[0] == 0
+        && out[1][0].getTranslation()[1] == MAX_QUANTIZED * settings.translationStep
+        && out[1][0].getTranslation()[2] == -MAX_QUANTIZED * settings.translationStep
+        && norm(out[1][1].getTranslation() - Cvec3(0.5, 0, 0)) <= settings.translationStep;
+    check(extremeRestored, "non-finite translations");
+
+    std::cerr.clear();
+    cout << "testkeyframes: " << numChecks - numFailed << " of " << numChecks << " checks passed ("
+         << stream.numKeys << " of " << numFrames << " keys stored in " << bytes.size() << " bytes)" << endl;
+    return numFailed;
+}
+
+// Best time in seconds of numTrials calls of fn
+template <typename Fn>
+static double bestSeconds(int numTrials, Fn fn) {
+    double best = 0;
+    for (int trial = 0; trial < numTrials; ++trial) {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        fn();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (trial == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+// q[i] = q[i] * r[i] with the quaternion product of Kernel, numPasses times
+template <typename Kernel>
+static void multiplyQuats(std::vector<Cvec4>& q, const std::vector<Cvec4>& r, int numPasses) {
+    for (int pass = 0; pass < numPasses; ++pass) {
+        for (std::size_t i = 0; i < q.size(); ++i) {
+            Cvec4 product;
+            Kernel::mul(&q[i][0], &r[i][0], &product[0]);
+            q[i] = product;
+        }
+    }
+}
+
+// d[i] = dot(a[i], b[i]) with the dot product of Kernel, numPasses times
+template <typename Kernel, typename T>
+static void computeDots(const std::vector<Cvec<T, 4> >& a, const std::vector<Cvec<T, 4> >& b, std::vector<T>& d, int numPasses) {
+    for (int pass = 0; pass < numPasses; ++pass) {
+        for (std::size_t i = 0; i < a.size(); ++i) {
+            d[i] = Kernel::dot(&a[i][0], &b[i][0]);
+        }
+    }
+}
+
+// Headless microbenchmark of the SIMD kernels (asst6 -benchsimd [numPasses]):
+// times the CvecKernel and QuatKernel specializations against the scalar
+// templates that CS175_NO_SIMD compiles instead, numPasses passes over 4096
+// elements, best of 5 runs, and reports the largest difference of their results.
+static void benchmarkSimd(int numPasses) {
+    static const int NUM_ELEMENTS = 4096, NUM_TRIALS = 5;
+
+    std::mt19937 rng(175);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    std::vector<Cvec4> a(NUM_ELEMENTS), b(NUM_ELEMENTS);
+    std::vector<Cvec4f> af(NUM_ELEMENTS), bf(NUM_ELEMENTS);
+    for (int i = 0; i < NUM_ELEMENTS; ++i) {
+        a[i] = Cvec4(uniform(rng), uniform(rng), uniform(rng), uniform(rng)).normalize();
+        b[i] = Cvec4(uniform(rng), uniform(rng), uniform(rng), uniform(rng)).normalize();
+        af[i] = Cvec4f(a[i]);
+        bf[i] = Cvec4f(b[i]);
+    }
+
+#if defined(CS175_SIMD_SSE2)
+    const char* simd = "SSE2";
+#elif defined(CS175_SIMD_NEON)
+    const char* simd = "NEON";
+#else
+    const char* simd = "none";
+#endif
+    cout << "benchsimd: " << NUM_ELEMENTS << " elements x " << numPasses << " passes, best of "
+         << NUM_TRIALS << " runs, SIMD: " << simd << endl;
+    auto report = [](const char* name, double scalarSeconds, double simdSeconds, double difference) {
+        cout << "  " << name << ": scalar " << scalarSeconds << " s, SIMD " << simdSeconds << " s, "
+             << scalarSeconds / simdSeconds << "x, max. difference " << difference << endl;
+    };
+
+    std::vector<Cvec4> scalarQ, simdQ;
+    const double quatScalar = bestSeconds(NUM_TRIALS, [&]() {
+        scalarQ = a;
+        multiplyQuats<QuatScalarKernel<double> >(scalarQ, b, numPasses);
+    });
+    const double quatSimd = bestSeconds(NUM_TRIALS, [&]() {
+        simdQ = a;
+        multiplyQuats<QuatKernel<double> >(simdQ, b, numPasses);
+    });
+    scalarQ = simdQ = a;
+    multiplyQuats<QuatScalarKernel<double> >(scalarQ, b, 1);
+    multiplyQuats<QuatKernel<double> >(simdQ, b, 1);
+    double quatDifference = 0;
+    for (int i = 0; i < NUM_ELEMENTS; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            quatDifference = std::max(quatDifference, std::abs(scalarQ[i][c] - simdQ[i][c]));
+        }
+    }
+    report("Quat * Quat", quatScalar, quatSimd, quatDifference);
+
+    std::vector<double> d(NUM_ELEMENTS), simdD(NUM_ELEMENTS);
+    const double dotScalar = bestSeconds(NUM_TRIALS, [&]() { computeDots<CvecScalarKernel<double, 4> >(a, b, d, numPasses); });
+    const double dotSimd = bestSeconds(NUM_TRIALS, [&]() { computeDots<CvecKernel<double, 4> >(a, b, simdD, numPasses); });
+    double dotDifference = 0;
+    for (int i = 0; i < NUM_ELEMENTS; ++i) {
+        dotDifference = std::max(dotDifference, std::abs(d[i] - simdD[i]));
+    }
+    report("dot(Cvec4)", dotScalar, dotSimd, dotDifference);
+
+    std::vector<float> df(NUM_ELEMENTS), simdDf(NUM_ELEMENTS);
+    const double dotfScalar = bestSeconds(NUM_TRIALS, [&]() { computeDots<CvecScalarKernel<float, 4> >(af, bf, df, numPasses); });
+    const double dotfSimd = bestSeconds(NUM_TRIALS, [&]() { computeDots<CvecKernel<float, 4> >(af, bf, simdDf, numPasses); });
+    double dotfDifference = 0;
+    for (int i = 0; i < NUM_ELEMENTS; ++i) {
+        dotfDifference = std::max(dotfDifference, static_cast<double>(std::abs(df[i] - simdDf[i])));
+    }
+    report("dot(Cvec4f)", dotfScalar, dotfSimd, dotfDifference);
+}
+
 int main(int argc, char* argv[]) {
     try {
+        if (argc > 1 && std::string(argv[1]) == "-benchfur") {
+            benchmarkFur(argc > 2 ? std::atoi(argv[2]) : 10000, argc > 3 ? std::atoi(argv[3]) : 0);
+            return 0;
+        }
+        if (argc > 1 && std::string(argv[1]) == "-testkeyframes") {
+            return testKeyframeCompression() == 0 ? 0 : 1;
+        }
+        if (argc > 1 && std::string(argv[1]) == "-benchanim") {
+            benchmarkAnimation(argc > 2 ? std::atoi(argv[2]) : 2000, argc > 3 ? std::atoi(argv[3]) : 40,
+                               argc > 4 ? std::atoi(argv[4]) : 300, argc > 5 ? std::atoi(argv[5]) : 0);
+            return 0;
+        }
+        if (argc > 1 && std::string(argv[1]) == "-benchsimd") {
+            benchmarkSimd(argc > 2 ? std::atoi(argv[2]) : 2000);
+            return 0;
+        }
+
         initGlutState(argc, argv);
 
         glewInit(); // load the OpenGL extensions
@@ -1220,12 +1862,15 @@ int main(int argc, char* argv[]) {
             throw runtime_error("Error: card/driver does not support OpenGL Shading Language v1.3");
         else if (g_Gl2Compatible && !GLEW_VERSION_2_0)
             throw runtime_error("Error: card/driver does not support OpenGL Shading Language v1.0");
+        if (!GLEW_ARB_draw_instanced)
+            throw runtime_error("Error: card/driver does not support ARB_draw_instanced");
 
         initGLState();
         initMaterials();
         initGeometry();
         initScene();
         initSimulation();
+        glutTimerFunc(0, frameTimerCallback, 0);
         glutMainLoop();
         return 0;
     }
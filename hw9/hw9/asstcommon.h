@@ -15,8 +15,14 @@ extern const bool g_Gl2Compatible;
 extern std::shared_ptr<Material> g_overridingMaterial;
 
 // takes MVM and its normal matrix to the shaders
-inline void sendModelViewNormalMatrix(Uniforms& uniforms, const Matrix4& MVM, const Matrix4& NMVM) {
+template <typename T>
+inline void sendModelViewNormalMatrix(Uniforms& uniforms, const Matrix4T<T>& MVM, const Matrix4T<T>& NMVM) {
   uniforms.put("uModelViewMatrix", MVM).put("uNormalMatrix", NMVM);
 }
 
+template <typename T>
+inline void sendModelViewNormalMatrix(Uniforms& uniforms, const AffineMatrixT<T>& MVM, const AffineMatrixT<T>& NMVM) {
+  sendModelViewNormalMatrix(uniforms, MVM.toMatrix4(), NMVM.toMatrix4());
+}
+
 #endif
\ No newline at end of file
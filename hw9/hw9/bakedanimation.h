@@ -0,0 +1,151 @@
+#ifndef BAKEDANIMATION_H
+#define BAKEDANIMATION_H
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "animation.h"
+
+namespace Animation {
+
+	//! Keyframe timeline sampled at a fixed rate into one contiguous pose buffer
+	//!
+	//! Sample #k holds the frame interpolated at t = k * msPerSample / msBetweenKeyFrames,
+	//! and poseAt(ms) returns the last sample at or before ms, so playback from
+	//! the bake only copies poses. Each sample is held for msPerSample milliseconds,
+	//! so a baked pose lags the live pose at ms by up to one sample. A bake remembers the keyframe
+	//! revision and the settings it was made with and is ignored once any of them changes.
+	//!
+	//! bakeAsync samples a snapshot of the keyframes on a worker thread.
+	//! The result is picked up by the next call to isValidFor.
+	class BakedAnimation {
+	public:
+		BakedAnimation() : cancel_(false) {}
+
+		~BakedAnimation() {
+			cancelPending();
+		}
+
+		BakedAnimation(const BakedAnimation&) = delete;
+		BakedAnimation& operator = (const BakedAnimation&) = delete;
+
+		//! Sample keyframes on the calling thread
+		void bake(const KeyframeList& keyframes, int msPerSample, int msBetweenKeyFrames) {
+			cancelPending();
+			baked_ = sample(keyframes, makeKey(keyframes, msPerSample, msBetweenKeyFrames), cancel_);
+		}
+
+		//! Sample a copy of keyframes on a worker thread
+		//! Does nothing if the current or the pending bake already matches
+		void bakeAsync(const KeyframeList& keyframes, int msPerSample, int msBetweenKeyFrames) {
+			const Key key = makeKey(keyframes, msPerSample, msBetweenKeyFrames);
+			if ((baked_ && baked_->key == key) || (pending_.valid() && pendingKey_ == key))
+				return;
+
+			cancelPending();
+			pendingKey_ = key;
+			pending_ = std::async(std::launch::async, &BakedAnimation::sample, keyframes, key, std::ref(cancel_));
+		}
+
+		//! Returns true if the bake is up to date with keyframes and the playback settings
+		bool isValidFor(const KeyframeList& keyframes, int msPerSample, int msBetweenKeyFrames) {
+			if (pending_.valid() && pending_.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+				std::shared_ptr<Bake> result = pending_.get();
+				if (result)
+					baked_ = result;
+			}
+			return baked_ && baked_->key == makeKey(keyframes, msPerSample, msBetweenKeyFrames);
+		}
+
+		//! Pose of all nodes at the last sample at or before ms milliseconds into the playback,
+		//! NULL if ms lies beyond the end of the animation
+		//! Only meaningful if isValidFor returned true
+		const RigTForm* poseAt(int ms) const {
+			const int k = ms / baked_->key.msPerSample;
+			if (k < 0 || k >= baked_->numSamples)
+				return NULL;
+			return &baked_->poses[static_cast<std::size_t>(k) * baked_->numRbts];
+		}
+
+		//! Number of samples held by the current bake
+		int numSamples() const {
+			return baked_ ? baked_->numSamples : 0;
+		}
+
+		//! Drop the current bake and stop the pending one
+		void clear() {
+			cancelPending();
+			baked_.reset();
+		}
+
+	private:
+		struct Key {
+			unsigned revision;
+			InterpolationMode mode;
+			int msPerSample;
+			int msBetweenKeyFrames;
+
+			bool operator == (const Key& k) const {
+				return revision == k.revision && mode == k.mode
+					&& msPerSample == k.msPerSample && msBetweenKeyFrames == k.msBetweenKeyFrames;
+			}
+		};
+
+		struct Bake {
+			Key key;
+			int numRbts;
+			int numSamples;
+			std::vector<RigTForm> poses;    // numSamples * numRbts, sample after sample
+		};
+
+		static Key makeKey(const KeyframeList& keyframes, int msPerSample, int msBetweenKeyFrames) {
+			Key key;
+			key.revision = keyframes.getRevision();
+			key.mode = keyframes.getInterpolationMode();
+			key.msPerSample = msPerSample;
+			key.msBetweenKeyFrames = msBetweenKeyFrames;
+			return key;
+		}
+
+		//! Returns NULL if cancelled
+		static std::shared_ptr<Bake> sample(KeyframeList keyframes, Key key, const std::atomic<bool>& cancel) {
+			std::shared_ptr<Bake> bake = std::make_shared<Bake>();
+			bake->key = key;
+			bake->numRbts = 0;
+			bake->numSamples = 0;
+
+			Frame frame;
+			for (int ms = 0; !cancel; ms += key.msPerSample) {
+				// same expression as in animateAt, so sample #k matches the live pose at k * msPerSample bit for bit
+				float t = static_cast<float>(ms) / static_cast<float>(key.msBetweenKeyFrames);
+				if (keyframes.interpolateKeyframes(t, frame))
+					return bake;
+
+				bake->numRbts = static_cast<int>(frame.size());
+				bake->poses.insert(bake->poses.end(), frame.begin(), frame.end());
+				bake->numSamples++;
+			}
+			return std::shared_ptr<Bake>();
+		}
+
+		void cancelPending() {
+			if (pending_.valid()) {
+				cancel_ = true;
+				pending_.wait();
+				pending_ = std::future<std::shared_ptr<Bake> >();
+				cancel_ = false;
+			}
+		}
+
+	private:
+		std::shared_ptr<Bake> baked_;
+		std::future<std::shared_ptr<Bake> > pending_;
+		Key pendingKey_;
+		std::atomic<bool> cancel_;
+	};
+}
+
+#endif
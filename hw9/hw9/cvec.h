@@ -5,48 +5,228 @@
 #include <cassert>
 #include <algorithm>
 
+// SIMD code paths for 4-vectors of floats and doubles, define CS175_NO_SIMD to disable them
+#if !defined(CS175_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define CS175_SIMD_SSE2
+#include <emmintrin.h>
+#elif !defined(CS175_NO_SIMD) && defined(__ARM_NEON) && defined(__aarch64__)
+#define CS175_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+
+static constexpr double CS175_PI = 3.14159265358979323846264338327950288;
+static constexpr double CS175_EPS = 1e-8;
+static constexpr double CS175_EPS2 = CS175_EPS * CS175_EPS;
+static constexpr double CS175_EPS3 = CS175_EPS * CS175_EPS * CS175_EPS;
+
+// The math classes can be used in constant expressions, e.g. to build
+// geometry tables or fixed transforms at compile time. SIMD intrinsics and
+// <cmath> functions are not constexpr, so during constant evaluation the
+// scalar code paths and the series below are used instead. Telling the two
+// cases apart needs __builtin_is_constant_evaluated (GCC 9, Clang 9,
+// MSVC 2019 16.5); without it the run-time paths are always taken and only
+// the parts free of SIMD and <cmath> calls are usable at compile time.
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define CS175_HAS_CONSTANT_EVALUATED
+#endif
+#endif
+#if !defined(CS175_HAS_CONSTANT_EVALUATED) && \
+    ((defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 9) || (defined(_MSC_VER) && _MSC_VER >= 1925))
+#define CS175_HAS_CONSTANT_EVALUATED
+#endif
+
+// true while the compiler evaluates a constant expression
+constexpr bool isConstantEvaluated() {
+#if defined(CS175_HAS_CONSTANT_EVALUATED)
+  return __builtin_is_constant_evaluated();
+#else
+  return false;
+#endif
+}
+
+constexpr double cxAbs(const double x) {
+  return x < 0 ? -x : x;
+}
+
+// square root, Newton's method at compile time
+constexpr double cxSqrt(const double x) {
+  if (!isConstantEvaluated())
+    return std::sqrt(x);
+  if (x <= 0)
+    return 0;
+  double r = x > 1 ? x : 1;
+  for (int i = 0; i < 100; ++i) {
+    const double next = 0.5 * (r + x / r);
+    if (next >= r)
+      break;
+    r = next;
+  }
+  return r;
+}
+
+// sine of x radians, Taylor series around 0 after reduction to [-pi/2, pi/2] at compile time
+constexpr double cxSin(double x) {
+  if (!isConstantEvaluated())
+    return std::sin(x);
+  const double twoPi = 2 * CS175_PI;
+  x -= twoPi * static_cast<long long>(x / twoPi);    // (-2pi, 2pi)
+  if (x > CS175_PI)
+    x -= twoPi;
+  else if (x < -CS175_PI)
+    x += twoPi;                                      // [-pi, pi]
+  if (x > CS175_PI / 2)
+    x = CS175_PI - x;
+  else if (x < -CS175_PI / 2)
+    x = -CS175_PI - x;                               // [-pi/2, pi/2]
+  double term = x, r = x;
+  for (int k = 1; k < 14; ++k) {
+    term *= -x * x / ((2 * k) * (2 * k + 1));
+    r += term;
+  }
+  return r;
+}
 
-static const double CS175_PI = 3.14159265358979323846264338327950288;
-static const double CS175_EPS = 1e-8;
-static const double CS175_EPS2 = CS175_EPS * CS175_EPS;
-static const double CS175_EPS3 = CS175_EPS * CS175_EPS * CS175_EPS;
+constexpr double cxCos(const double x) {
+  if (!isConstantEvaluated())
+    return std::cos(x);
+  return cxSin(x + CS175_PI / 2);
+}
+
+// Squared tolerance of the consistency checks (asserts) on results computed
+// in precision T, e.g. norm2(m * inv(m) - identity)
+template <typename T>
+struct CheckTolerance {
+  static constexpr double eps2() { return CS175_EPS2; }
+};
+
+template <>
+struct CheckTolerance<float> {
+  static constexpr double eps2() { return CS175_EPS; }
+};
 
 
+// Element-wise kernels used by Cvec. The scalar version loops over the
+// elements, the CvecKernel specializations below use SIMD registers for the
+// dot product of 4-vectors. add, sub and scale stay scalar: the compiler
+// already vectorizes their loops, and SIMD versions measured no faster
+// (asst6 -benchsimd). Loads are unaligned, so Cvec keeps its plain T[n]
+// layout (which vertex formats and uniform uploads rely on).
+template <typename T, int n>
+struct CvecScalarKernel {
+  static constexpr void add(T* a, const T* b) {
+    for (int i = 0; i < n; ++i) {
+      a[i] += b[i];
+    }
+  }
+
+  static constexpr void sub(T* a, const T* b) {
+    for (int i = 0; i < n; ++i) {
+      a[i] -= b[i];
+    }
+  }
+
+  static constexpr void scale(T* a, const T s) {
+    for (int i = 0; i < n; ++i) {
+      a[i] *= s;
+    }
+  }
+
+  static constexpr T dot(const T* a, const T* b) {
+    T r(0);
+    for (int i = 0; i < n; ++i) {
+      r += a[i]*b[i];
+    }
+    return r;
+  }
+};
+
+template <typename T, int n>
+struct CvecKernel : CvecScalarKernel<T, n> {};
+
+#if defined(CS175_SIMD_SSE2)
+
+template <>
+struct CvecKernel<float, 4> : CvecScalarKernel<float, 4> {
+  static float dot(const float* a, const float* b) {
+    const __m128 p = _mm_mul_ps(_mm_loadu_ps(a), _mm_loadu_ps(b));
+    const __m128 s = _mm_add_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 0, 3, 2)));   // (0+2, 1+3, ...)
+    return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(0, 0, 0, 1))));
+  }
+};
+
+template <>
+struct CvecKernel<double, 4> : CvecScalarKernel<double, 4> {
+  static double dot(const double* a, const double* b) {
+    const __m128d s = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(a), _mm_loadu_pd(b)),
+                                 _mm_mul_pd(_mm_loadu_pd(a + 2), _mm_loadu_pd(b + 2)));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+  }
+};
+
+#elif defined(CS175_SIMD_NEON)
+
+template <>
+struct CvecKernel<float, 4> : CvecScalarKernel<float, 4> {
+  static float dot(const float* a, const float* b) {
+    return vaddvq_f32(vmulq_f32(vld1q_f32(a), vld1q_f32(b)));
+  }
+};
+
+template <>
+struct CvecKernel<double, 4> : CvecScalarKernel<double, 4> {
+  static double dot(const double* a, const double* b) {
+    return vaddvq_f64(vaddq_f64(vmulq_f64(vld1q_f64(a), vld1q_f64(b)),
+                                vmulq_f64(vld1q_f64(a + 2), vld1q_f64(b + 2))));
+  }
+};
+
+#endif
+
 template <typename T, int n>
 class Cvec {
   T d_[n];
 
 public:
-  Cvec() {
+  constexpr Cvec() : d_() {
     for (int i = 0; i < n; ++i) {
       d_[i] = 0;
     }
   }
 
-  Cvec(const T& t) {
+  constexpr Cvec(const T& t) : d_() {
     for (int i = 0; i < n; ++i) {
       d_[i] = t;
     }
   }
 
-  Cvec(const T& t0, const T& t1) {
+  constexpr Cvec(const T& t0, const T& t1) : d_() {
     assert(n == 2); // better to use static_assert from c++11
     d_[0] = t0, d_[1] = t1;
   }
 
-  Cvec(const T& t0, const T& t1, const T& t2) {
+  constexpr Cvec(const T& t0, const T& t1, const T& t2) : d_() {
     assert(n == 3); // better to use static_assert from c++11
     d_[0] = t0, d_[1] = t1, d_[2] = t2;
   }
 
-  Cvec(const T& t0, const T& t1, const T& t2, const T& t3) {
+  constexpr Cvec(const T& t0, const T& t1, const T& t2, const T& t3) : d_() {
     assert(n == 4); // better to use static_assert from c++11
     d_[0] = t0, d_[1] = t1, d_[2] = t2, d_[3] = t3;
   }
 
+  // conversion between precisions, e.g. Cvec3f(v) for a Cvec3 v
+  template<typename S>
+  explicit constexpr Cvec(const Cvec<S, n>& v) : d_() {
+    for (int i = 0; i < n; ++i) {
+      d_[i] = T(v[i]);
+    }
+  }
+
   // either truncate if m < n, or extend with extendValue
   template<int m>
-  explicit Cvec(const Cvec<T, m>& v, const T& extendValue = T(0)) {
+  explicit constexpr Cvec(const Cvec<T, m>& v, const T& extendValue = T(0)) : d_() {
     for (int i = 0; i < std::min(m, n); ++i) {
       d_[i] = v[i];
     }
@@ -55,106 +235,104 @@ public:
     }
   }
 
-  T& operator [] (const int i) {
+  constexpr T& operator [] (const int i) {
     return d_[i];
   }
 
-  const T& operator [] (const int i) const {
+  constexpr const T& operator [] (const int i) const {
     return d_[i];
   }
 
-  T& operator () (const int i) {
+  constexpr T& operator () (const int i) {
     return d_[i];
   }
 
-  const T& operator () (const int i) const {
+  constexpr const T& operator () (const int i) const {
     return d_[i];
   }
 
-  Cvec operator - () const {
+  constexpr Cvec operator - () const {
     return Cvec(*this) *= -1;
   }
 
-  Cvec& operator += (const Cvec& v) {
-    for (int i = 0; i < n; ++i) {
-      d_[i] += v[i];
-    }
+  constexpr Cvec& operator += (const Cvec& v) {
+    if (isConstantEvaluated())
+      CvecScalarKernel<T, n>::add(d_, v.d_);
+    else
+      CvecKernel<T, n>::add(d_, v.d_);
     return *this;
   }
 
-  Cvec& operator -= (const Cvec& v) {
-    for (int i = 0; i < n; ++i) {
-      d_[i] -= v[i];
-    }
+  constexpr Cvec& operator -= (const Cvec& v) {
+    if (isConstantEvaluated())
+      CvecScalarKernel<T, n>::sub(d_, v.d_);
+    else
+      CvecKernel<T, n>::sub(d_, v.d_);
     return *this;
   }
 
-  Cvec& operator *= (const T a) {
-    for (int i = 0; i < n; ++i) {
-      d_[i] *= a;
-    }
+  constexpr Cvec& operator *= (const T a) {
+    if (isConstantEvaluated())
+      CvecScalarKernel<T, n>::scale(d_, a);
+    else
+      CvecKernel<T, n>::scale(d_, a);
     return *this;
   }
 
-  Cvec& operator /= (const T a) {
+  constexpr Cvec& operator /= (const T a) {
     const T inva(1/a);
-    for (int i = 0; i < n; ++i) {
-      d_[i] *= inva;
-    }
-    return *this;
+    return *this *= inva;
   }
 
-  Cvec operator + (const Cvec& v) const {
+  constexpr Cvec operator + (const Cvec& v) const {
     return Cvec(*this) += v;
   }
 
-  Cvec operator - (const Cvec& v) const {
+  constexpr Cvec operator - (const Cvec& v) const {
     return Cvec(*this) -= v;
   }
 
-  Cvec operator * (const T a) const {
+  constexpr Cvec operator * (const T a) const {
     return Cvec(*this) *= a;
   }
 
-  Cvec operator / (const T a) const {
+  constexpr Cvec operator / (const T a) const {
     return Cvec(*this) /= a;
   }
 
   // Normalize self and returns self
-  Cvec& normalize() {
+  constexpr Cvec& normalize() {
     assert(dot(*this, *this) > CS175_EPS2);
-    return *this /= std::sqrt(dot(*this, *this));
+    return *this /= cxSqrt(dot(*this, *this));
   }
 };
 
 template<typename T>
-inline Cvec<T,3> cross(const Cvec<T,3>& a, const Cvec<T,3>& b) {
+inline constexpr Cvec<T,3> cross(const Cvec<T,3>& a, const Cvec<T,3>& b) {
   return Cvec<T,3>(a(1)*b(2)-a(2)*b(1), a(2)*b(0)-a(0)*b(2), a(0)*b(1)-a(1)*b(0));
 }
 
 template<typename T, int n>
-inline T dot(const Cvec<T,n>& a, const Cvec<T,n>& b) {
-  T r(0);
-  for (int i = 0; i < n; ++i) {
-    r += a(i)*b(i);
-  }
-  return r;
+inline constexpr T dot(const Cvec<T,n>& a, const Cvec<T,n>& b) {
+  if (isConstantEvaluated())
+    return CvecScalarKernel<T, n>::dot(&a[0], &b[0]);
+  return CvecKernel<T, n>::dot(&a[0], &b[0]);
 }
 
 template<typename T, int n>
-inline T norm2(const Cvec<T, n>& v) {
+inline constexpr T norm2(const Cvec<T, n>& v) {
   return dot(v, v);
 }
 
 template<typename T, int n>
-inline T norm(const Cvec<T, n>& v) {
-  return std::sqrt(dot(v, v));
+inline constexpr T norm(const Cvec<T, n>& v) {
+  return cxSqrt(dot(v, v));
 }
 
 // Return a normalized vector without modifying the input (unlike the member
 // function version v.normalize() ).
 template<typename T, int n>
-inline Cvec<T, n> normalize(const Cvec<T,n>& v) {
+inline constexpr Cvec<T, n> normalize(const Cvec<T,n>& v) {
  //  assert(dot(v, v) > CS175_EPS2);
   if (dot(v, v) < CS175_EPS2) {
       return Cvec<T, n>(0);
@@ -11,10 +11,12 @@ class Drawer : public SgNodeVisitor {
 protected:
   std::vector<RigTForm> rbtStack_;
   Uniforms& uniforms_;
+  int numDrawCalls_;
 public:
   Drawer(const RigTForm& initialRbt, Uniforms& uniforms)
     : rbtStack_(1, initialRbt)
-    , uniforms_(uniforms) {}
+    , uniforms_(uniforms)
+    , numDrawCalls_(0) {}
 
   virtual bool visit(SgTransformNode& node) {
     rbtStack_.push_back(rbtStack_.back() * node.getRbt());
@@ -27,9 +29,11 @@ public:
   }
 
   virtual bool visit(SgShapeNode& shapeNode) {
-    const Matrix4 MVM = rigTFormToMatrix(rbtStack_.back()) * shapeNode.getAffineMatrix();
+    // the transforms are composed in double, the shaders get floats
+    const AffineMatrixf MVM(rigTFormToAffineMatrix(rbtStack_.back()) * shapeNode.getAffineMatrix());
     sendModelViewNormalMatrix(uniforms_, MVM, normalMatrix(MVM));
     shapeNode.draw(uniforms_);
+    ++numDrawCalls_;
     return true;
   }
 
@@ -40,6 +44,11 @@ public:
   Uniforms& getUniforms() {
     return uniforms_;
   }
+
+  // Number of shape nodes drawn so far, each is one draw call
+  int getNumDrawCalls() const {
+    return numDrawCalls_;
+  }
 };
 
 #endif
@@ -0,0 +1,178 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+//! Drives animation, simulation and rendering from one monotonic clock
+//!
+//! The owner calls tick() once per frame (e.g. from a GLUT timer) and then
+//!   - samples animations at time(),
+//!   - runs Tick::simulationSteps fixed-size simulation steps. Elapsed time is
+//!     accumulated and consumed in whole steps, so the simulation advances at
+//!     the same rate no matter how the frames are spaced. At most
+//!     maxStepsPerTick steps are run per frame, the excess time is dropped,
+//!   - redraws if Tick::render is set. A frame that starts more than one frame
+//!     period after its deadline is not rendered (at most MAX_SKIPPED_FRAMES in
+//!     a row) so that the loop can catch up,
+//!   - waits msUntilNextFrame() before the next tick.
+//!
+//! Jitter (deviation of the tick interval from the frame period) and latency
+//! (delay of a tick behind its deadline) are collected for printStats().
+class FrameScheduler {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	static const int MAX_SKIPPED_FRAMES = 2;
+
+	struct Tick {
+		double time;             // seconds since the scheduler was created
+		int simulationSteps;     // fixed simulation steps to run in this frame
+		bool render;             // false if this frame should not be drawn
+	};
+
+	FrameScheduler(int framesPerSecond, int stepsPerSecond, int maxStepsPerTick = 5)
+		: start_(Clock::now()), maxSteps_(maxStepsPerTick) {
+		setFrameRate(framesPerSecond);
+		setSimulationRate(stepsPerSecond);
+		restart();
+	}
+
+	void setFrameRate(int framesPerSecond) {
+		framePeriod_ = 1.0 / framesPerSecond;
+	}
+
+	//! stepsPerSecond <= 0 turns the simulation steps off
+	void setSimulationRate(int stepsPerSecond) {
+		stepPeriod_ = stepsPerSecond > 0 ? 1.0 / stepsPerSecond : 0;
+	}
+
+	//! Forget the tick history, e.g. after the loop was paused
+	//! The next tick is rendered and runs no simulation steps
+	void restart() {
+		started_ = false;
+		accumulator_ = 0;
+		skippedInARow_ = 0;
+		resetStats();
+	}
+
+	//! Seconds since the scheduler was created
+	double time() const {
+		return seconds(Clock::now() - start_);
+	}
+
+	//! Start a new frame
+	Tick tick() {
+		const Clock::time_point now = Clock::now();
+
+		Tick tick;
+		tick.time = seconds(now - start_);
+		tick.simulationSteps = 0;
+		tick.render = true;
+
+		if (!started_) {
+			started_ = true;
+			lastTick_ = now;
+			nextDeadline_ = now + period(framePeriod_);
+			numRendered_++;
+			return tick;
+		}
+
+		const double interval = seconds(now - lastTick_);
+		const double latency = std::max(0.0, seconds(now - nextDeadline_));
+		lastTick_ = now;
+		record(std::abs(interval - framePeriod_), latency);
+
+		// consume the elapsed time in whole simulation steps
+		int steps = 0;
+		if (stepPeriod_ > 0) {
+			accumulator_ += interval;
+			steps = static_cast<int>(accumulator_ / stepPeriod_);
+			accumulator_ -= steps * stepPeriod_;
+		}
+		if (steps > maxSteps_) {
+			numDroppedSteps_ += steps - maxSteps_;
+			steps = maxSteps_;
+		}
+		tick.simulationSteps = steps;
+		numSteps_ += steps;
+
+		// skip drawing when more than a whole frame behind
+		if (latency > framePeriod_ && skippedInARow_ < MAX_SKIPPED_FRAMES) {
+			tick.render = false;
+			skippedInARow_++;
+			numSkipped_++;
+		}
+		else {
+			skippedInARow_ = 0;
+			numRendered_++;
+		}
+
+		// keep the frame grid, unless we fell behind it
+		nextDeadline_ += period(framePeriod_);
+		if (nextDeadline_ < now)
+			nextDeadline_ = now;
+		return tick;
+	}
+
+	//! Milliseconds to wait before the next tick
+	int msUntilNextFrame() const {
+		const double ms = 1000 * seconds(nextDeadline_ - Clock::now());
+		return ms > 0 ? static_cast<int>(std::ceil(ms)) : 0;
+	}
+
+	void resetStats() {
+		numTicks_ = 0;
+		numRendered_ = 0;
+		numSkipped_ = 0;
+		numSteps_ = 0;
+		numDroppedSteps_ = 0;
+		sumJitter_ = maxJitter_ = 0;
+		sumLatency_ = maxLatency_ = 0;
+	}
+
+	void printStats() const {
+		const int n = std::max(numTicks_, 1);
+		std::cout << "Frames: " << numRendered_ << " rendered, " << numSkipped_ << " skipped\n";
+		if (stepPeriod_ > 0)
+			std::cout << "Simulation steps: " << numSteps_ << " run, " << numDroppedSteps_ << " dropped\n";
+		std::cout << "Jitter: avg. " << 1000 * sumJitter_ / n << " ms, max. " << 1000 * maxJitter_ << " ms\n"
+			<< "Latency: avg. " << 1000 * sumLatency_ / n << " ms, max. " << 1000 * maxLatency_ << " ms\n";
+	}
+
+private:
+	static double seconds(Clock::duration d) {
+		return std::chrono::duration<double>(d).count();
+	}
+
+	static Clock::duration period(double s) {
+		return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(s));
+	}
+
+	void record(double jitter, double latency) {
+		numTicks_++;
+		sumJitter_ += jitter;
+		maxJitter_ = std::max(maxJitter_, jitter);
+		sumLatency_ += latency;
+		maxLatency_ = std::max(maxLatency_, latency);
+	}
+
+	Clock::time_point start_;
+	Clock::time_point lastTick_;
+	Clock::time_point nextDeadline_;
+	bool started_;
+
+	double framePeriod_;
+	double stepPeriod_;
+	double accumulator_;    // elapsed time not yet consumed by simulation steps
+	int maxSteps_;
+	int skippedInARow_;
+
+	int numTicks_, numRendered_, numSkipped_, numSteps_, numDroppedSteps_;
+	double sumJitter_, maxJitter_;
+	double sumLatency_, maxLatency_;
+};
+
+#endif
@@ -0,0 +1,573 @@
+#ifndef FURSIMULATION_H
+#define FURSIMULATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "cvec.h"
+#include "matrix4.h"
+#include "rigtform.h"
+#include "mesh.h"
+#include "signeddistancefield.h"
+#include "threadpool.h"
+
+//! Hair tip dynamics of a furry mesh
+//!
+//! Every mesh vertex carries one hair from its root to its tip. The tip is
+//! pulled towards the straight (at-rest) tip by a spring and by gravity, and
+//! is kept at distance furHeight from the root. Vertices outside any face have
+//! no normal, so their hair starts on the root; like normalize(), the length
+//! constraint treats hairs shorter than CS175_EPS as having no direction,
+//! which keeps these tips finite.
+//!
+//! All state is stored as structure of arrays in single precision. Each
+//! simulate() call transforms the roots and the at-rest tips to world frame
+//! once, then runs Params::numSteps steps of the force/integrate/constraint
+//! kernel of Params::integrator. The kernels handle four tips at a time with
+//! SSE2 or NEON when available and give the same results as the scalar
+//! version.
+//!
+//! The tips are split into partitions of PARTITION_SIZE tips that are spread
+//! over a thread pool. A partition runs all the steps of a frame while its
+//! state stays in cache. Partitions start at multiples of PARTITION_SIZE and
+//! tips do not interact, so the results do not depend on the thread count.
+//!
+//! Partitions also are the unit of sleeping: once the velocity and the force
+//! across the hair of every tip in a partition drop below Params::sleepSpeed
+//! and Params::sleepForce at the end of a simulate() call, the partition is
+//! skipped until the mesh frame or the dynamics parameters change.
+//!
+//! With a collider set, every step ends by pushing the tips that came closer
+//! than Params::collisionMargin to it back out along the gradient of its
+//! signed distance field, then back onto their hair, and by keeping only the
+//! part of their velocity that neither the hair nor the collider cancels.
+//! That is one grid lookup per tip, whatever the mesh.
+class FurSimulation {
+public:
+	//! Tips per partition: 512 tips use 24 KB of tip, velocity, root and
+	//! at-rest tip state, which fits in the L1 data cache. Multiple of 4 so
+	//! that only the last partition has a scalar tail.
+	static const int PARTITION_SIZE = 512;
+
+	//! Integration schemes of simulate()
+	enum Integrator {
+		EXPLICIT,   // velocity from the force, then the moved tip is put back on the hair
+		VERLET      // position based: the tip is moved and put back, the velocity is the distance it moved
+	};
+
+	struct Params {
+		Integrator integrator;
+		Cvec3f gravity;     // world frame
+		float stiffness;    // spring constant pulling the tip to its at-rest position
+		float damping;      // velocity factor applied after every step
+		float timeStep;
+		float furHeight;    // hair length
+		int numSteps;       // steps per simulate() call
+		float sleepSpeed;   // tip speed below which a tip may sleep, 0 to never sleep
+		float sleepForce;   // force across the hair below which a tip may sleep
+		float collisionMargin; // distance the tips keep from the collider
+	};
+
+	//! threadPool must outlive this simulation
+	explicit FurSimulation(ThreadPool& threadPool) : pool_(threadPool), numTips_(0), numActiveTips_(0), params_(), collider_(NULL) {}
+
+	//! Place one hair on every vertex of mesh (object frame) with its tip at rest,
+	//! frame brings the mesh to world frame
+	void init(Mesh& mesh, const RigTFormf& frame, float furHeight) {
+		numTips_ = mesh.getNumVertices();
+		resize(rootObject_);
+		resize(normalObject_);
+		resize(root_);
+		resize(rest_);
+		resize(tip_);
+		resize(velocity_);
+		for (int i = 0; i < numTips_; ++i) {
+			const Cvec3f p(mesh.getVertex(i).getPosition());
+			const Cvec3f n(mesh.getVertex(i).getNormal());
+			for (int c = 0; c < 3; ++c) {
+				rootObject_[c][i] = p[c];
+				normalObject_[c][i] = n[c];
+				velocity_[c][i] = 0;
+			}
+		}
+		frame_ = rigTFormToAffineMatrix(frame);
+		updateWorldFrame(frame_, furHeight, 0, numTips_);
+		for (int c = 0; c < 3; ++c)
+			tip_[c] = rest_[c];
+		asleep_.assign((numTips_ + PARTITION_SIZE - 1) / PARTITION_SIZE, 0);
+		contact_.assign(numTips_, 0);
+		resize(frameStart_);
+		numActiveTips_ = numTips_;
+		params_ = Params();
+	}
+
+	int getNumTips() const {
+		return numTips_;
+	}
+
+	//! Tip of hair i in world frame
+	Cvec3f getTip(int i) const {
+		return Cvec3f(tip_[0][i], tip_[1][i], tip_[2][i]);
+	}
+
+	//! Write all tips, transformed by frame (e.g. to the mesh object frame), to out
+	void getTips(const RigTFormf& frame, Cvec3f* out) const {
+		const AffineMatrixf m = rigTFormToAffineMatrix(frame);
+		for (int i = 0; i < numTips_; ++i) {
+			const float x = tip_[0][i], y = tip_[1][i], z = tip_[2][i];
+			out[i] = Cvec3f(m(0, 0) * x + m(0, 1) * y + m(0, 2) * z + m(0, 3),
+			                m(1, 0) * x + m(1, 1) * y + m(1, 2) * z + m(1, 3),
+			                m(2, 0) * x + m(2, 1) * y + m(2, 2) * z + m(2, 3));
+		}
+	}
+
+	//! Collide the tips with collider from the next simulate() on, NULL for none
+	//! collider is in the object frame of the mesh and must outlive its use
+	void setCollider(const SignedDistanceField* collider) {
+		collider_ = collider;
+		wake();
+	}
+
+	//! Advance the awake hairs by p.numSteps steps, frame is the current mesh to world transform
+	//! All hairs are woken if frame or the dynamics in p differ from the last call
+	void simulate(const RigTFormf& frame, const Params& p) {
+		const AffineMatrixf m = rigTFormToAffineMatrix(frame);
+		const AffineMatrixf invM = rigTFormToAffineMatrix(inv(frame));
+		if (!sameFrame(m, frame_) || !sameDynamics(p, params_))
+			wake();
+		frame_ = m;
+		params_ = p;
+		if (numActiveTips_ == 0)
+			return;
+
+		// chunks hold whole partitions, a pool without workers runs all of them in one
+		pool_.parallelFor(numTips_, PARTITION_SIZE, [&](int chunkBegin, int chunkEnd) {
+			for (int begin = chunkBegin; begin < chunkEnd; begin += PARTITION_SIZE) {
+				const int end = std::min(begin + PARTITION_SIZE, chunkEnd);
+				char& asleep = asleep_[begin / PARTITION_SIZE];
+				if (asleep)
+					continue;
+				updateWorldFrame(m, p.furHeight, begin, end);
+				if (collider_) {
+					std::fill(contact_.begin() + begin, contact_.begin() + end, 0);
+					for (int c = 0; c < 3; ++c)
+						std::copy(tip_[c].begin() + begin, tip_[c].begin() + end, frameStart_[c].begin() + begin);
+				}
+				for (int step = 0; step < p.numSteps; ++step) {
+					if (p.integrator == VERLET)
+						stepVerlet(begin, end, p);
+					else
+						stepExplicit(begin, end, p);
+					if (collider_)
+						collideRange(m, invM, begin, end, p);
+				}
+				asleep = isSettled(begin, end, p);
+			}
+		});
+
+		numActiveTips_ = 0;
+		for (size_t k = 0; k < asleep_.size(); ++k) {
+			if (!asleep_[k])
+				numActiveTips_ += std::min<int>(PARTITION_SIZE, numTips_ - k * PARTITION_SIZE);
+		}
+	}
+
+	//! Make all hairs move again from the next simulate() on
+	void wake() {
+		std::fill(asleep_.begin(), asleep_.end(), 0);
+		numActiveTips_ = numTips_;
+	}
+
+	//! Tips stepped by the next simulate() unless it wakes all of them
+	int getNumActiveTips() const {
+		return numActiveTips_;
+	}
+
+	int getNumThreads() const {
+		return pool_.numThreads();
+	}
+
+private:
+	typedef std::vector<float> Channel;
+
+	void resize(Channel* soa) {
+		for (int c = 0; c < 3; ++c)
+			soa[c].assign(numTips_, 0.f);
+	}
+
+	//! Bring the roots and the at-rest tips in [begin, end) to world frame with m
+	void updateWorldFrame(const AffineMatrixf& m, float furHeight, int begin, int end) {
+		const float* px = rootObject_[0].data(), * py = rootObject_[1].data(), * pz = rootObject_[2].data();
+		const float* nx = normalObject_[0].data(), * ny = normalObject_[1].data(), * nz = normalObject_[2].data();
+		for (int c = 0; c < 3; ++c) {
+			const float m0 = m(c, 0), m1 = m(c, 1), m2 = m(c, 2), m3 = m(c, 3);
+			float* root = root_[c].data();
+			float* rest = rest_[c].data();
+			for (int i = begin; i < end; ++i) {
+				root[i] = m0 * px[i] + m1 * py[i] + m2 * pz[i] + m3;
+				rest[i] = root[i] + (m0 * nx[i] + m1 * ny[i] + m2 * nz[i]) * furHeight;
+			}
+		}
+	}
+
+	static bool sameFrame(const AffineMatrixf& a, const AffineMatrixf& b) {
+		for (int r = 0; r < 3; ++r) {
+			for (int c = 0; c < 4; ++c) {
+				if (a(r, c) != b(r, c))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	//! Whether a and b give the same motion (the sleep thresholds do not count)
+	static bool sameDynamics(const Params& a, const Params& b) {
+		return a.integrator == b.integrator && a.gravity[0] == b.gravity[0] && a.gravity[1] == b.gravity[1] && a.gravity[2] == b.gravity[2]
+			&& a.stiffness == b.stiffness && a.damping == b.damping && a.timeStep == b.timeStep
+			&& a.furHeight == b.furHeight && a.numSteps == b.numSteps && a.collisionMargin == b.collisionMargin;
+	}
+
+	//! Whether the velocity of every tip in [begin, end) is below p.sleepSpeed
+	//! and the force on it below p.sleepForce. Only the parts across the hair
+	//! count: the length constraint cancels the rest, which is why a tip at
+	//! rest keeps a constant velocity along its hair with the EXPLICIT integrator.
+	//! A tip pushed out of the collider in this frame is held against the force
+	//! by it, and its velocity may be cancelled as well, so for those only the
+	//! distance the tip actually moved in the frame counts.
+	bool isSettled(int begin, int end, const Params& p) const {
+		const float speed2 = p.sleepSpeed * p.sleepSpeed, force2 = p.sleepForce * p.sleepForce;
+		const float frameTime = p.timeStep * p.numSteps;
+		for (int i = begin; i < end; ++i) {
+			const Cvec3f t(tip_[0][i], tip_[1][i], tip_[2][i]);
+			if (collider_ && contact_[i]) {
+				const Cvec3f start(frameStart_[0][i], frameStart_[1][i], frameStart_[2][i]);
+				if (norm2(t - start) >= speed2 * frameTime * frameTime)
+					return false;
+				continue;
+			}
+
+			const Cvec3f u = (t - Cvec3f(root_[0][i], root_[1][i], root_[2][i])) * (1.f / p.furHeight);
+
+			const Cvec3f v(velocity_[0][i], velocity_[1][i], velocity_[2][i]);
+			if (norm2(v - u * dot(v, u)) >= speed2)
+				return false;
+
+			const Cvec3f f = p.gravity + (Cvec3f(rest_[0][i], rest_[1][i], rest_[2][i]) - t) * p.stiffness;
+			if (norm2(f - u * dot(f, u)) >= force2)
+				return false;
+		}
+		return true;
+	}
+
+	//! Push the tips in [begin, end) that are closer than p.collisionMargin to
+	//! the collider out along its gradient and back onto their hair. Their
+	//! velocity keeps only the part along the surface and across the hair,
+	//! which neither constraint cancels, so tips do not bounce off the collider.
+	//! m is the mesh object to world transform, invM its inverse.
+	void collideRange(const AffineMatrixf& m, const AffineMatrixf& invM, int begin, int end, const Params& p) {
+		for (int i = begin; i < end; ++i) {
+			const Cvec3f t(tip_[0][i], tip_[1][i], tip_[2][i]);
+			const Cvec3f q = transformPoint(invM, t);
+			if (collider_->sample(q) >= p.collisionMargin)
+				continue;
+			Cvec3f gradient;
+			const float d = collider_->sample(q, &gradient);
+			const float gradient2 = norm2(gradient);
+			if (gradient2 == 0)
+				continue;
+			contact_[i] = 1;
+
+			const Cvec3f n = transformVector(m, gradient * (1.f / std::sqrt(gradient2)));
+			const Cvec3f r(root_[0][i], root_[1][i], root_[2][i]);
+			const Cvec3f u = normalize(t + n * (p.collisionMargin - d) - r);
+			const Cvec3f free = cross(u, n);
+			const float free2 = norm2(free);
+			const Cvec3f v(velocity_[0][i], velocity_[1][i], velocity_[2][i]);
+			const Cvec3f w = free2 > 0 ? free * (dot(v, free) / free2) : Cvec3f(0);
+			for (int c = 0; c < 3; ++c) {
+				tip_[c][i] = r[c] + u[c] * p.furHeight;
+				velocity_[c][i] = w[c];
+			}
+		}
+	}
+
+	static Cvec3f transformPoint(const AffineMatrixf& m, const Cvec3f& p) {
+		return Cvec3f(m(0, 0) * p[0] + m(0, 1) * p[1] + m(0, 2) * p[2] + m(0, 3),
+		              m(1, 0) * p[0] + m(1, 1) * p[1] + m(1, 2) * p[2] + m(1, 3),
+		              m(2, 0) * p[0] + m(2, 1) * p[1] + m(2, 2) * p[2] + m(2, 3));
+	}
+
+	static Cvec3f transformVector(const AffineMatrixf& m, const Cvec3f& v) {
+		return Cvec3f(m(0, 0) * v[0] + m(0, 1) * v[1] + m(0, 2) * v[2],
+		              m(1, 0) * v[0] + m(1, 1) * v[1] + m(1, 2) * v[2],
+		              m(2, 0) * v[0] + m(2, 1) * v[1] + m(2, 2) * v[2]);
+	}
+
+	//! One explicit step of the tips in [begin, end):
+	//!   f = g + (s - t) * stiffness
+	//!   t = r + normalize(t + v * timeStep - r) * furHeight
+	//!   v = (v + f * timeStep) * damping
+	//! with root r, at-rest tip s, tip t and velocity v. The velocity keeps
+	//! the part along the hair that the projection takes away from the tip, so
+	//! larger steps overshoot; it needs about ten steps per frame.
+	void stepExplicit(int begin, int end, const Params& p) {
+		float* tx = tip_[0].data(), * ty = tip_[1].data(), * tz = tip_[2].data();
+		float* vx = velocity_[0].data(), * vy = velocity_[1].data(), * vz = velocity_[2].data();
+		const float* rx = root_[0].data(), * ry = root_[1].data(), * rz = root_[2].data();
+		const float* sx = rest_[0].data(), * sy = rest_[1].data(), * sz = rest_[2].data();
+		const float minLength2 = static_cast<float>(CS175_EPS2);
+
+		int i = begin;
+#if defined(CS175_SIMD_SSE2)
+		const __m128 gx = _mm_set1_ps(p.gravity[0]), gy = _mm_set1_ps(p.gravity[1]), gz = _mm_set1_ps(p.gravity[2]);
+		const __m128 k = _mm_set1_ps(p.stiffness), d = _mm_set1_ps(p.damping);
+		const __m128 dt = _mm_set1_ps(p.timeStep), h = _mm_set1_ps(p.furHeight), minLen2 = _mm_set1_ps(minLength2);
+		for (; i + 4 <= end; i += 4) {
+			const __m128 x = _mm_loadu_ps(tx + i), y = _mm_loadu_ps(ty + i), z = _mm_loadu_ps(tz + i);
+			const __m128 ux = _mm_loadu_ps(vx + i), uy = _mm_loadu_ps(vy + i), uz = _mm_loadu_ps(vz + i);
+			const __m128 px = _mm_loadu_ps(rx + i), py = _mm_loadu_ps(ry + i), pz = _mm_loadu_ps(rz + i);
+
+			const __m128 fx = _mm_add_ps(gx, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(sx + i), x), k));
+			const __m128 fy = _mm_add_ps(gy, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(sy + i), y), k));
+			const __m128 fz = _mm_add_ps(gz, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(sz + i), z), k));
+
+			const __m128 dx = _mm_sub_ps(_mm_add_ps(x, _mm_mul_ps(ux, dt)), px);
+			const __m128 dy = _mm_sub_ps(_mm_add_ps(y, _mm_mul_ps(uy, dt)), py);
+			const __m128 dz = _mm_sub_ps(_mm_add_ps(z, _mm_mul_ps(uz, dt)), pz);
+			const __m128 len2 = _mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)), minLen2);
+			const __m128 s = _mm_div_ps(h, _mm_sqrt_ps(len2));
+			_mm_storeu_ps(tx + i, _mm_add_ps(px, _mm_mul_ps(dx, s)));
+			_mm_storeu_ps(ty + i, _mm_add_ps(py, _mm_mul_ps(dy, s)));
+			_mm_storeu_ps(tz + i, _mm_add_ps(pz, _mm_mul_ps(dz, s)));
+
+			_mm_storeu_ps(vx + i, _mm_mul_ps(_mm_add_ps(ux, _mm_mul_ps(fx, dt)), d));
+			_mm_storeu_ps(vy + i, _mm_mul_ps(_mm_add_ps(uy, _mm_mul_ps(fy, dt)), d));
+			_mm_storeu_ps(vz + i, _mm_mul_ps(_mm_add_ps(uz, _mm_mul_ps(fz, dt)), d));
+		}
+#elif defined(CS175_SIMD_NEON)
+		const float32x4_t gx = vdupq_n_f32(p.gravity[0]), gy = vdupq_n_f32(p.gravity[1]), gz = vdupq_n_f32(p.gravity[2]);
+		const float32x4_t k = vdupq_n_f32(p.stiffness), d = vdupq_n_f32(p.damping);
+		const float32x4_t dt = vdupq_n_f32(p.timeStep), h = vdupq_n_f32(p.furHeight), minLen2 = vdupq_n_f32(minLength2);
+		for (; i + 4 <= end; i += 4) {
+			const float32x4_t x = vld1q_f32(tx + i), y = vld1q_f32(ty + i), z = vld1q_f32(tz + i);
+			const float32x4_t ux = vld1q_f32(vx + i), uy = vld1q_f32(vy + i), uz = vld1q_f32(vz + i);
+			const float32x4_t px = vld1q_f32(rx + i), py = vld1q_f32(ry + i), pz = vld1q_f32(rz + i);
+
+			const float32x4_t fx = vaddq_f32(gx, vmulq_f32(vsubq_f32(vld1q_f32(sx + i), x), k));
+			const float32x4_t fy = vaddq_f32(gy, vmulq_f32(vsubq_f32(vld1q_f32(sy + i), y), k));
+			const float32x4_t fz = vaddq_f32(gz, vmulq_f32(vsubq_f32(vld1q_f32(sz + i), z), k));
+
+			const float32x4_t dx = vsubq_f32(vaddq_f32(x, vmulq_f32(ux, dt)), px);
+			const float32x4_t dy = vsubq_f32(vaddq_f32(y, vmulq_f32(uy, dt)), py);
+			const float32x4_t dz = vsubq_f32(vaddq_f32(z, vmulq_f32(uz, dt)), pz);
+			const float32x4_t len2 = vmaxq_f32(vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)), vmulq_f32(dz, dz)), minLen2);
+			const float32x4_t s = vdivq_f32(h, vsqrtq_f32(len2));
+			vst1q_f32(tx + i, vaddq_f32(px, vmulq_f32(dx, s)));
+			vst1q_f32(ty + i, vaddq_f32(py, vmulq_f32(dy, s)));
+			vst1q_f32(tz + i, vaddq_f32(pz, vmulq_f32(dz, s)));
+
+			vst1q_f32(vx + i, vmulq_f32(vaddq_f32(ux, vmulq_f32(fx, dt)), d));
+			vst1q_f32(vy + i, vmulq_f32(vaddq_f32(uy, vmulq_f32(fy, dt)), d));
+			vst1q_f32(vz + i, vmulq_f32(vaddq_f32(uz, vmulq_f32(fz, dt)), d));
+		}
+#endif
+		// remaining tips, in the same order of operations as the vector version
+		for (; i < end; ++i) {
+			const float fx = p.gravity[0] + (sx[i] - tx[i]) * p.stiffness;
+			const float fy = p.gravity[1] + (sy[i] - ty[i]) * p.stiffness;
+			const float fz = p.gravity[2] + (sz[i] - tz[i]) * p.stiffness;
+
+			const float dx = (tx[i] + vx[i] * p.timeStep) - rx[i];
+			const float dy = (ty[i] + vy[i] * p.timeStep) - ry[i];
+			const float dz = (tz[i] + vz[i] * p.timeStep) - rz[i];
+			const float s = p.furHeight / std::sqrt(std::max((dx * dx + dy * dy) + dz * dz, minLength2));
+			tx[i] = rx[i] + dx * s;
+			ty[i] = ry[i] + dy * s;
+			tz[i] = rz[i] + dz * s;
+
+			vx[i] = (vx[i] + fx * p.timeStep) * p.damping;
+			vy[i] = (vy[i] + fy * p.timeStep) * p.damping;
+			vz[i] = (vz[i] + fz * p.timeStep) * p.damping;
+		}
+	}
+
+	//! One position based (Verlet) step of the tips in [begin, end):
+	//!   f = g + (s - t) * stiffness
+	//!   u = r + normalize(t + (v + f * timeStep) * damping * timeStep - r) * furHeight
+	//!   v = (u - t) / timeStep
+	//!   t = u
+	//! The velocity is what the tip actually moved, so the length constraint
+	//! removes its part along the hair as well, which keeps one or two steps
+	//! per frame stable.
+	void stepVerlet(int begin, int end, const Params& p) {
+		float* tx = tip_[0].data(), * ty = tip_[1].data(), * tz = tip_[2].data();
+		float* vx = velocity_[0].data(), * vy = velocity_[1].data(), * vz = velocity_[2].data();
+		const float* rx = root_[0].data(), * ry = root_[1].data(), * rz = root_[2].data();
+		const float* sx = rest_[0].data(), * sy = rest_[1].data(), * sz = rest_[2].data();
+		const float invTimeStep = 1.f / p.timeStep;
+		const float minLength2 = static_cast<float>(CS175_EPS2);
+
+		int i = begin;
+#if defined(CS175_SIMD_SSE2)
+		const __m128 gx = _mm_set1_ps(p.gravity[0]), gy = _mm_set1_ps(p.gravity[1]), gz = _mm_set1_ps(p.gravity[2]);
+		const __m128 k = _mm_set1_ps(p.stiffness), d = _mm_set1_ps(p.damping);
+		const __m128 dt = _mm_set1_ps(p.timeStep), invDt = _mm_set1_ps(invTimeStep), h = _mm_set1_ps(p.furHeight);
+		const __m128 minLen2 = _mm_set1_ps(minLength2);
+		for (; i + 4 <= end; i += 4) {
+			const __m128 x = _mm_loadu_ps(tx + i), y = _mm_loadu_ps(ty + i), z = _mm_loadu_ps(tz + i);
+			const __m128 px = _mm_loadu_ps(rx + i), py = _mm_loadu_ps(ry + i), pz = _mm_loadu_ps(rz + i);
+
+			const __m128 fx = _mm_add_ps(gx, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(sx + i), x), k));
+			const __m128 fy = _mm_add_ps(gy, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(sy + i), y), k));
+			const __m128 fz = _mm_add_ps(gz, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(sz + i), z), k));
+			const __m128 ux = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(vx + i), _mm_mul_ps(fx, dt)), d);
+			const __m128 uy = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(vy + i), _mm_mul_ps(fy, dt)), d);
+			const __m128 uz = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(vz + i), _mm_mul_ps(fz, dt)), d);
+
+			const __m128 dx = _mm_sub_ps(_mm_add_ps(x, _mm_mul_ps(ux, dt)), px);
+			const __m128 dy = _mm_sub_ps(_mm_add_ps(y, _mm_mul_ps(uy, dt)), py);
+			const __m128 dz = _mm_sub_ps(_mm_add_ps(z, _mm_mul_ps(uz, dt)), pz);
+			const __m128 len2 = _mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)), minLen2);
+			const __m128 s = _mm_div_ps(h, _mm_sqrt_ps(len2));
+			const __m128 nx = _mm_add_ps(px, _mm_mul_ps(dx, s));
+			const __m128 ny = _mm_add_ps(py, _mm_mul_ps(dy, s));
+			const __m128 nz = _mm_add_ps(pz, _mm_mul_ps(dz, s));
+
+			_mm_storeu_ps(vx + i, _mm_mul_ps(_mm_sub_ps(nx, x), invDt));
+			_mm_storeu_ps(vy + i, _mm_mul_ps(_mm_sub_ps(ny, y), invDt));
+			_mm_storeu_ps(vz + i, _mm_mul_ps(_mm_sub_ps(nz, z), invDt));
+			_mm_storeu_ps(tx + i, nx);
+			_mm_storeu_ps(ty + i, ny);
+			_mm_storeu_ps(tz + i, nz);
+		}
+#elif defined(CS175_SIMD_NEON)
+		const float32x4_t gx = vdupq_n_f32(p.gravity[0]), gy = vdupq_n_f32(p.gravity[1]), gz = vdupq_n_f32(p.gravity[2]);
+		const float32x4_t k = vdupq_n_f32(p.stiffness), d = vdupq_n_f32(p.damping);
+		const float32x4_t dt = vdupq_n_f32(p.timeStep), invDt = vdupq_n_f32(invTimeStep), h = vdupq_n_f32(p.furHeight);
+		const float32x4_t minLen2 = vdupq_n_f32(minLength2);
+		for (; i + 4 <= end; i += 4) {
+			const float32x4_t x = vld1q_f32(tx + i), y = vld1q_f32(ty + i), z = vld1q_f32(tz + i);
+			const float32x4_t px = vld1q_f32(rx + i), py = vld1q_f32(ry + i), pz = vld1q_f32(rz + i);
+
+			const float32x4_t fx = vaddq_f32(gx, vmulq_f32(vsubq_f32(vld1q_f32(sx + i), x), k));
+			const float32x4_t fy = vaddq_f32(gy, vmulq_f32(vsubq_f32(vld1q_f32(sy + i), y), k));
+			const float32x4_t fz = vaddq_f32(gz, vmulq_f32(vsubq_f32(vld1q_f32(sz + i), z), k));
+			const float32x4_t ux = vmulq_f32(vaddq_f32(vld1q_f32(vx + i), vmulq_f32(fx, dt)), d);
+			const float32x4_t uy = vmulq_f32(vaddq_f32(vld1q_f32(vy + i), vmulq_f32(fy, dt)), d);
+			const float32x4_t uz = vmulq_f32(vaddq_f32(vld1q_f32(vz + i), vmulq_f32(fz, dt)), d);
+
+			const float32x4_t dx = vsubq_f32(vaddq_f32(x, vmulq_f32(ux, dt)), px);
+			const float32x4_t dy = vsubq_f32(vaddq_f32(y, vmulq_f32(uy, dt)), py);
+			const float32x4_t dz = vsubq_f32(vaddq_f32(z, vmulq_f32(uz, dt)), pz);
+			const float32x4_t len2 = vmaxq_f32(vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)), vmulq_f32(dz, dz)), minLen2);
+			const float32x4_t s = vdivq_f32(h, vsqrtq_f32(len2));
+			const float32x4_t nx = vaddq_f32(px, vmulq_f32(dx, s));
+			const float32x4_t ny = vaddq_f32(py, vmulq_f32(dy, s));
+			const float32x4_t nz = vaddq_f32(pz, vmulq_f32(dz, s));
+
+			vst1q_f32(vx + i, vmulq_f32(vsubq_f32(nx, x), invDt));
+			vst1q_f32(vy + i, vmulq_f32(vsubq_f32(ny, y), invDt));
+			vst1q_f32(vz + i, vmulq_f32(vsubq_f32(nz, z), invDt));
+			vst1q_f32(tx + i, nx);
+			vst1q_f32(ty + i, ny);
+			vst1q_f32(tz + i, nz);
+		}
+#endif
+		// remaining tips, in the same order of operations as the vector version
+		for (; i < end; ++i) {
+			const float fx = p.gravity[0] + (sx[i] - tx[i]) * p.stiffness;
+			const float fy = p.gravity[1] + (sy[i] - ty[i]) * p.stiffness;
+			const float fz = p.gravity[2] + (sz[i] - tz[i]) * p.stiffness;
+			const float ux = (vx[i] + fx * p.timeStep) * p.damping;
+			const float uy = (vy[i] + fy * p.timeStep) * p.damping;
+			const float uz = (vz[i] + fz * p.timeStep) * p.damping;
+
+			const float dx = (tx[i] + ux * p.timeStep) - rx[i];
+			const float dy = (ty[i] + uy * p.timeStep) - ry[i];
+			const float dz = (tz[i] + uz * p.timeStep) - rz[i];
+			const float s = p.furHeight / std::sqrt(std::max((dx * dx + dy * dy) + dz * dz, minLength2));
+			const float nx = rx[i] + dx * s;
+			const float ny = ry[i] + dy * s;
+			const float nz = rz[i] + dz * s;
+
+			vx[i] = (nx - tx[i]) * invTimeStep;
+			vy[i] = (ny - ty[i]) * invTimeStep;
+			vz[i] = (nz - tz[i]) * invTimeStep;
+			tx[i] = nx;
+			ty[i] = ny;
+			tz[i] = nz;
+		}
+	}
+
+	ThreadPool& pool_;
+	int numTips_;
+	int numActiveTips_;          // tips in awake partitions
+	std::vector<char> asleep_;   // per partition, written by the partition's own task only
+	AffineMatrixf frame_;        // mesh to world transform and parameters of the last simulate()
+	Params params_;
+	Channel rootObject_[3];      // hair roots in object frame, one array per coordinate
+	Channel normalObject_[3];    // mesh normals (root to at-rest tip direction) in object frame
+	Channel root_[3];            // hair roots in world frame
+	Channel rest_[3];            // at-rest tips in world frame
+	Channel tip_[3];             // tips in world frame
+	Channel velocity_[3];        // tip velocities in world frame
+	const SignedDistanceField* collider_;   // in mesh object frame, NULL for none
+	std::vector<char> contact_;  // per tip, pushed out of the collider by a step of the last simulate()
+	Channel frameStart_[3];      // tips at the start of the last simulate(), kept while there is a collider
+};
+
+//! Finds the tips that moved noticeably since they were last taken
+//!
+//! update() compares the tips to the reference positions, which are the tips
+//! as of the last time they moved by more than threshold. Tips that moved
+//! further are flagged and become the new reference, the others keep their
+//! reference so that slow drifts still get picked up once they add up.
+class TipMotionTracker {
+public:
+	explicit TipMotionTracker(float threshold) : threshold2_(threshold * threshold) {}
+
+	//! Distance a tip has to move to be flagged, from the next update() on
+	void setThreshold(float threshold) {
+		threshold2_ = threshold * threshold;
+	}
+
+	//! Flag and take the tips that moved, returns how many did
+	//! All tips are flagged when their count changed
+	int update(const Cvec3f* tips, int count) {
+		const bool resized = static_cast<int>(reference_.size()) != count;
+		reference_.resize(count);
+		moved_.assign(count, resized);
+		if (resized) {
+			std::copy(tips, tips + count, reference_.begin());
+			return count;
+		}
+
+		int numMoved = 0;
+		for (int i = 0; i < count; ++i) {
+			if (norm2(tips[i] - reference_[i]) > threshold2_) {
+				reference_[i] = tips[i];
+				moved_[i] = true;
+				numMoved++;
+			}
+		}
+		return numMoved;
+	}
+
+	//! Whether tip i moved in the last update()
+	bool hasMoved(int i) const {
+		return moved_[i] != 0;
+	}
+
+	//! Positions the tips had when they were last taken
+	const std::vector<Cvec3f>& getReference() const {
+		return reference_;
+	}
+
+private:
+	float threshold2_;
+	std::vector<Cvec3f> reference_;
+	std::vector<char> moved_;
+};
+
+#endif
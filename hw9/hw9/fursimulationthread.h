@@ -0,0 +1,139 @@
+#ifndef FURSIMULATIONTHREAD_H
+#define FURSIMULATIONTHREAD_H
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "framescheduler.h"
+#include "fursimulation.h"
+#include "triplebuffer.h"
+
+//! Runs a FurSimulation on its own thread at a fixed rate
+//!
+//! The render thread hands in the mesh frame and the parameters with
+//! setInput() and takes the tips of the latest finished step with
+//! acquireTips(). Both directions go through a TripleBuffer, so neither
+//! thread blocks on the other and the render thread always sees the tips of
+//! one whole step. Steps are scheduled like the simulation steps of a
+//! FrameScheduler: at most a few catch-up steps are run when the thread fell
+//! behind, the remaining time is dropped. Once all hairs sleep the tips are
+//! published one last time and then no more until some hair wakes up.
+class FurSimulationThread {
+public:
+	struct Input {
+		RigTFormf frame;    // mesh to world transform
+		FurSimulation::Params params;
+	};
+
+	//! simulation (and its thread pool) must outlive this object and must not be
+	//! used by anyone else while the thread is running
+	FurSimulationThread(FurSimulation& simulation, int stepsPerSecond)
+		: simulation_(simulation), scheduler_(stepsPerSecond, stepsPerSecond), settledPublished_(false), stop_(false), numSteps_(0), numActiveTips_(0), sumStepMs_(0) {}
+
+	~FurSimulationThread() {
+		stop();
+	}
+
+	FurSimulationThread(const FurSimulationThread&) = delete;
+	FurSimulationThread& operator = (const FurSimulationThread&) = delete;
+
+	//! Publish the current tips and start stepping with input
+	void start(const Input& input) {
+		if (thread_.joinable())
+			return;
+		input_ = input;
+		publishTips();
+		settledPublished_ = false;
+		numActiveTips_ = simulation_.getNumActiveTips();
+		stop_ = false;
+		thread_ = std::thread(&FurSimulationThread::run, this);
+	}
+
+	//! Wait for the current step to finish and end the thread
+	void stop() {
+		if (!thread_.joinable())
+			return;
+		stop_ = true;
+		thread_.join();
+	}
+
+	//! Input used from the next step on, called by the render thread
+	void setInput(const Input& input) {
+		inputs_.getWriteBuffer() = input;
+		inputs_.publish();
+	}
+
+	//! Switch getTips() to the latest finished step, called by the render thread
+	//! Returns false if no step finished since the last call
+	bool acquireTips() {
+		return tips_.acquire();
+	}
+
+	//! Tips in world frame as of the last acquireTips() (or start())
+	const std::vector<Cvec3f>& getTips() const {
+		return tips_.getReadBuffer();
+	}
+
+	//! Tips stepped by the latest step, 0 once the whole fur sleeps
+	int getNumActiveTips() const {
+		return numActiveTips_;
+	}
+
+	void printStats() const {
+		const int n = numSteps_;
+		std::cout << "Fur simulation: " << n << " steps, avg. " << (n > 0 ? sumStepMs_ / n : 0.0)
+			<< " ms per step (" << simulation_.getNumThreads() << " threads), "
+			<< numActiveTips_ << " of " << simulation_.getNumTips() << " tips active\n";
+	}
+
+private:
+	void run() {
+		scheduler_.restart();
+		while (!stop_) {
+			const FrameScheduler::Tick tick = scheduler_.tick();
+			if (inputs_.acquire())
+				input_ = inputs_.getReadBuffer();
+
+			if (tick.simulationSteps > 0) {
+				const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for (int step = 0; step < tick.simulationSteps; ++step)
+					simulation_.simulate(input_.frame, input_.params);
+				const bool settled = simulation_.getNumActiveTips() == 0;
+				if (!settled || !settledPublished_)
+					publishTips();
+				settledPublished_ = settled;
+				numActiveTips_ = simulation_.getNumActiveTips();
+				sumStepMs_ = sumStepMs_ + std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				numSteps_ += tick.simulationSteps;
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(scheduler_.msUntilNextFrame()));
+		}
+	}
+
+	void publishTips() {
+		std::vector<Cvec3f>& tips = tips_.getWriteBuffer();
+		tips.resize(simulation_.getNumTips());
+		if (!tips.empty())
+			simulation_.getTips(RigTFormf(), &tips[0]);
+		tips_.publish();
+	}
+
+	FurSimulation& simulation_;
+	FrameScheduler scheduler_;             // owned by the simulation thread
+	Input input_;                          // owned by the simulation thread
+	bool settledPublished_;                // owned by the simulation thread, the published tips are at rest
+	TripleBuffer<Input> inputs_;           // render thread -> simulation thread
+	TripleBuffer<std::vector<Cvec3f> > tips_;    // simulation thread -> render thread
+
+	std::thread thread_;
+	std::atomic<bool> stop_;
+	std::atomic<int> numSteps_;
+	std::atomic<int> numActiveTips_;
+	std::atomic<double> sumStepMs_;
+};
+
+#endif
@@ -25,7 +25,8 @@ const VertexFormat VertexPNTBX::FORMAT = VertexFormat(sizeof(VertexPNTBX))
 
 BufferObjectGeometry::BufferObjectGeometry()
   : wiringChanged_(true),
-  primitiveType_(GL_TRIANGLES)
+  primitiveType_(GL_TRIANGLES),
+  numInstances_(1)
 {}
 
 BufferObjectGeometry& BufferObjectGeometry::wire(
@@ -74,6 +75,12 @@ BufferObjectGeometry& BufferObjectGeometry::primitiveType(GLenum primitiveType)
   return *this;
 }
 
+BufferObjectGeometry& BufferObjectGeometry::instances(int numInstances) {
+  assert(numInstances >= 1);
+  numInstances_ = numInstances;
+  return *this;
+}
+
 const vector<string>& BufferObjectGeometry::getVertexAttribNames() {
   if (wiringChanged_)
     processWiring();
@@ -105,10 +112,16 @@ void BufferObjectGeometry::draw(int attribIndices[]) {
 
   if (isIndexed()) {
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *ib_);
-    glDrawElements(primitiveType_, ib_->length(), ib_->getIndexFormat(), 0);
+    if (numInstances_ > 1)
+      glDrawElementsInstancedARB(primitiveType_, ib_->length(), ib_->getIndexFormat(), 0, numInstances_);
+    else
+      glDrawElements(primitiveType_, ib_->length(), ib_->getIndexFormat(), 0);
   }
   else if (vboLen != UNDEFINED_VB_LEN) {
-    glDrawArrays(primitiveType_, 0, vboLen);
+    if (numInstances_ > 1)
+      glDrawArraysInstancedARB(primitiveType_, 0, vboLen, numInstances_);
+    else
+      glDrawArrays(primitiveType_, 0, vboLen);
   }
 }
 
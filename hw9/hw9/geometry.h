@@ -153,6 +153,19 @@ public:
     }
 #ifndef NDEBUG
     checkGlErrors();
+#endif
+  }
+
+  // Overwrite vertices [first, first + count) of the data uploaded by the last upload()
+  // with glBufferSubData, the rest of the vbo is left as is
+  template<typename Vertex>
+  void uploadRange(const Vertex* vertices, int first, int count) {
+    assert(sizeof(Vertex) == format_.getVertexSize());
+    assert(first >= 0 && count >= 0 && first + count <= length_);
+    glBindBuffer(GL_ARRAY_BUFFER, *this);
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(Vertex) * first, sizeof(Vertex) * count, vertices);
+#ifndef NDEBUG
+    checkGlErrors();
 #endif
   }
 };
@@ -239,6 +252,10 @@ public:
   // Anything you can pass to glDrawArrays is fair game
   BufferObjectGeometry& primitiveType(GLenum primitiveType);
 
+  // Set the number of instances drawn by a single draw call using ARB_draw_instanced.
+  // Shaders tell the instances apart with gl_InstanceIDARB. Default is 1 (plain draw call)
+  BufferObjectGeometry& instances(int numInstances);
+
   // Return if we are in indexed mode
   bool isIndexed() const {
     return ib_ ? true : false;
@@ -249,6 +266,10 @@ public:
     return primitiveType_;
   }
 
+  int getNumInstances() const {
+    return numInstances_;
+  }
+
   // Methods declared by Geometry
   virtual const std::vector<std::string>& getVertexAttribNames();
   virtual void draw(int attribIndices[]);
@@ -257,6 +278,7 @@ private:
   typedef std::map<std::string, std::pair<std::shared_ptr<FormattedVbo>, std::string> > Wiring;
 
   GLenum primitiveType_;
+  int numInstances_;
   bool wiringChanged_;
   Wiring wiring_;
   std::shared_ptr<FormattedIbo> ib_;
@@ -302,26 +324,26 @@ struct VertexPN {
 
   static const VertexFormat FORMAT;
 
-  VertexPN() {}
+  constexpr VertexPN() {}
 
-  VertexPN(float x, float y, float z,
-           float nx, float ny, float nz)
+  constexpr VertexPN(float x, float y, float z,
+                     float nx, float ny, float nz)
     : p(x,y,z), n(nx, ny, nz) {}
 
-  VertexPN(const Cvec3f& pos, const Cvec3f& normal)
+  constexpr VertexPN(const Cvec3f& pos, const Cvec3f& normal)
     : p(pos), n(normal) {}
 
-  VertexPN(const Cvec3& pos, const Cvec3& normal)
+  constexpr VertexPN(const Cvec3& pos, const Cvec3& normal)
     : p(pos[0], pos[1], pos[2]), n(normal[0], normal[1], normal[2]) {}
 
 
   // Define copy constructor and assignment operator from GenericVertex so we can
   // use make* functions from geometrymaker.h
-  VertexPN(const GenericVertex& v) {
+  constexpr VertexPN(const GenericVertex& v) {
     *this = v;
   }
 
-  VertexPN& operator = (const GenericVertex& v) {
+  constexpr VertexPN& operator = (const GenericVertex& v) {
     p = v.pos;
     n = v.normal;
     return *this;
@@ -335,27 +357,27 @@ struct VertexPNX : public VertexPN {
 
   static const VertexFormat FORMAT;
 
-  VertexPNX() {}
+  constexpr VertexPNX() {}
 
-  VertexPNX(float x, float y, float z,
-            float nx, float ny, float nz,
-            float u, float v)
+  constexpr VertexPNX(float x, float y, float z,
+                      float nx, float ny, float nz,
+                      float u, float v)
     : VertexPN(x, y, z, nx, ny, nz), x(u, v) {}
 
-  VertexPNX(const Cvec3f& pos, const Cvec3f& normal, const Cvec2f& texCoords)
+  constexpr VertexPNX(const Cvec3f& pos, const Cvec3f& normal, const Cvec2f& texCoords)
     : VertexPN(pos, normal), x(texCoords) {}
 
-  VertexPNX(const Cvec3& pos, const Cvec3& normal, const Cvec2& texCoords)
+  constexpr VertexPNX(const Cvec3& pos, const Cvec3& normal, const Cvec2& texCoords)
     : VertexPN(pos, normal), x(texCoords[0], texCoords[1]) {}
 
 
   // Define copy constructor and assignment operator from GenericVertex so we can
   // use make* functions from geometrymaker.h
-  VertexPNX(const GenericVertex& v) {
+  constexpr VertexPNX(const GenericVertex& v) {
     *this = v;
   }
 
-  VertexPNX& operator = (const GenericVertex& v) {
+  constexpr VertexPNX& operator = (const GenericVertex& v) {
     p = v.pos;
     n = v.normal;
     x = v.tex;
@@ -370,30 +392,30 @@ struct VertexPNTBX : public VertexPNX {
 
   static const VertexFormat FORMAT;
 
-  VertexPNTBX() {}
+  constexpr VertexPNTBX() {}
 
-  VertexPNTBX(float x, float y, float z,
-              float nx, float ny, float nz,
-              float tx, float ty, float tz,
-              float bx, float by, float bz,
-              float u, float v)
+  constexpr VertexPNTBX(float x, float y, float z,
+                        float nx, float ny, float nz,
+                        float tx, float ty, float tz,
+                        float bx, float by, float bz,
+                        float u, float v)
     : VertexPNX(x, y, z, nx, ny, nz, u, v), t(tx, ty, tz), b(bx, by, bz) {}
 
-  VertexPNTBX(const Cvec3f& pos, const Cvec3f& normal,
-              const Cvec3f& tangent, const Cvec3f& binormal, const Cvec2f& texCoords)
+  constexpr VertexPNTBX(const Cvec3f& pos, const Cvec3f& normal,
+                        const Cvec3f& tangent, const Cvec3f& binormal, const Cvec2f& texCoords)
     : VertexPNX(pos, normal, texCoords), t(tangent), b(binormal) {}
 
-  VertexPNTBX(const Cvec3& pos, const Cvec3& normal,
-              const Cvec3& tangent, const Cvec3& binormal, const Cvec2& texCoords)
+  constexpr VertexPNTBX(const Cvec3& pos, const Cvec3& normal,
+                        const Cvec3& tangent, const Cvec3& binormal, const Cvec2& texCoords)
     : VertexPNX(pos, normal, texCoords), t(tangent[0], tangent[1], tangent[2]), b(binormal[0], binormal[1], binormal[2]) {}
 
   // Define copy constructor and assignment operator from GenericVertex so we can
   // use make* functions from geometrymaker.h
-  VertexPNTBX(const GenericVertex& v) {
+  constexpr VertexPNTBX(const GenericVertex& v) {
     *this = v;
   }
 
-  VertexPNTBX& operator = (const GenericVertex& v) {
+  constexpr VertexPNTBX& operator = (const GenericVertex& v) {
     p = v.pos;
     n = v.normal;
     t = v.tangent;
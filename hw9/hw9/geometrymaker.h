@@ -18,7 +18,7 @@ struct GenericVertex {
   Cvec2f tex;
   Cvec3f tangent, binormal;
 
-  GenericVertex(
+  constexpr GenericVertex(
     float x, float y, float z,
     float nx, float ny, float nz,
     float tu, float tv,
@@ -28,13 +28,19 @@ struct GenericVertex {
   {}
 };
 
+// Fixed vertex/index counts of the plane and the cube
+static constexpr int PLANE_VB_LEN = 4, PLANE_IB_LEN = 6;
+static constexpr int CUBE_VB_LEN = 24, CUBE_IB_LEN = 36;
+
 inline void getPlaneVbIbLen(int& vbLen, int& ibLen) {
-  vbLen = 4;
-  ibLen = 6;
+  vbLen = PLANE_VB_LEN;
+  ibLen = PLANE_IB_LEN;
 }
 
+// makePlane and makeCube are constexpr so that, writing through plain pointers,
+// they can fill a GeometryTable at compile time (see makeCubeTable below)
 template<typename VtxOutIter, typename IdxOutIter>
-void makePlane(float size, VtxOutIter vtxIter, IdxOutIter idxIter) {
+constexpr void makePlane(float size, VtxOutIter vtxIter, IdxOutIter idxIter) {
   float h = size / 2.0;
   *vtxIter = GenericVertex(    -h, 0, -h, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, -1);
   *(++vtxIter) = GenericVertex(-h, 0,  h, 0, 1, 0, 0, 1, 1, 0, 0, 0, 0, -1);
@@ -49,12 +55,12 @@ void makePlane(float size, VtxOutIter vtxIter, IdxOutIter idxIter) {
 }
 
 inline void getCubeVbIbLen(int& vbLen, int& ibLen) {
-  vbLen = 24;
-  ibLen = 36;
+  vbLen = CUBE_VB_LEN;
+  ibLen = CUBE_IB_LEN;
 }
 
 template<typename VtxOutIter, typename IdxOutIter>
-void makeCube(float size, VtxOutIter vtxIter, IdxOutIter idxIter) {
+constexpr void makeCube(float size, VtxOutIter vtxIter, IdxOutIter idxIter) {
   float h = size / 2.0;
 #define DEFV(x, y, z, nx, ny, nz, tu, tv) { \
     *vtxIter = GenericVertex(x h, y h, z h, \
@@ -105,7 +111,7 @@ void makeCube(float size, VtxOutIter vtxIter, IdxOutIter idxIter) {
   DEFV(+, -, -, 0, 0, -1, 0, 1);
 #undef DEFV
 
-  for (int v = 0; v < 24; v +=4) {
+  for (int v = 0; v < CUBE_VB_LEN; v +=4) {
     *idxIter = v;
     *++idxIter = v + 1;
     *++idxIter = v + 2;
@@ -116,6 +122,29 @@ void makeCube(float size, VtxOutIter vtxIter, IdxOutIter idxIter) {
   }
 }
 
+// Vertex and index arrays of a fixed size primitive, built by the make*Table
+// functions below. Declared as static constexpr, the table is computed by the
+// compiler and ends up in read-only data, ready to be uploaded as is.
+template<typename Vertex, int NV, int NI>
+struct GeometryTable {
+  Vertex vtx[NV];
+  unsigned short idx[NI];
+};
+
+template<typename Vertex>
+constexpr GeometryTable<Vertex, PLANE_VB_LEN, PLANE_IB_LEN> makePlaneTable(float size) {
+  GeometryTable<Vertex, PLANE_VB_LEN, PLANE_IB_LEN> t = {};
+  makePlane(size, &t.vtx[0], &t.idx[0]);
+  return t;
+}
+
+template<typename Vertex>
+constexpr GeometryTable<Vertex, CUBE_VB_LEN, CUBE_IB_LEN> makeCubeTable(float size) {
+  GeometryTable<Vertex, CUBE_VB_LEN, CUBE_IB_LEN> t = {};
+  makeCube(size, &t.vtx[0], &t.idx[0]);
+  return t;
+}
+
 inline void getSphereVbIbLen(int slices, int stacks, int& vbLen, int& ibLen) {
   assert(slices > 1);
   assert(stacks >= 2);
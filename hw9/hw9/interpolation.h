@@ -1,6 +1,9 @@
 #ifndef INTERPOLATION_H
 #define INTERPOLATION_H
 
+#include <cmath>
+#include <vector>
+
 #include "rigtform.h"
 
 namespace Interpolation {
@@ -29,5 +32,257 @@ namespace Interpolation {
 		Quat interRot = slerp(rbt0.getRotation(), rbt1.getRotation(), alpha);
 		return RigTForm(interTrans, interRot);
 	}
+
+	//! Conditionally negate a quaternion so that its first element is non-negative
+	inline Quat cn(const Quat& q) {
+		return q(0) < 0 ? q * -1 : q;
+	}
+
+	//! Bezier control points d, e of the Catmull-Rom segment between c1 and c2
+	//! where c0 and c3 are the neighbouring keyframes
+	inline void catmullRomControlPoints(const Cvec3& c0, const Cvec3& c1, const Cvec3& c2, const Cvec3& c3,
+		Cvec3& d, Cvec3& e) {
+		d = c1 + (c2 - c0) * (1.0 / 6);
+		e = c2 - (c3 - c1) * (1.0 / 6);
+	}
+
+	//! Quaternion counterpart of the above, where the differences become
+	//! (conditionally negated) quotients and the scaling becomes a power
+	inline void catmullRomControlPoints(const Quat& c0, const Quat& c1, const Quat& c2, const Quat& c3,
+		Quat& d, Quat& e) {
+		d = pow(cn(c2 * inv(c0)), 1.0 / 6) * c1;
+		e = pow(cn(c3 * inv(c1)), -1.0 / 6) * c2;
+	}
+
+	//! Structure-of-arrays storage for a sequence of RigTForms
+	//! Each component lives in its own contiguous array so that the
+	//! batched kernels below can process many nodes per instruction
+	class RigTFormArray {
+	public:
+		int size() const {
+			return static_cast<int>(t_[0].size());
+		}
+
+		void resize(int n) {
+			for (int c = 0; c < 3; ++c)
+				t_[c].resize(n);
+			for (int c = 0; c < 4; ++c)
+				q_[c].resize(n);
+		}
+
+		void set(int i, const RigTForm& rbt) {
+			const Cvec3 t = rbt.getTranslation();
+			const Quat q = rbt.getRotation();
+			for (int c = 0; c < 3; ++c)
+				t_[c][i] = t[c];
+			for (int c = 0; c < 4; ++c)
+				q_[c][i] = q[c];
+		}
+
+		RigTForm get(int i) const {
+			return RigTForm(Cvec3(t_[0][i], t_[1][i], t_[2][i]), Quat(q_[0][i], q_[1][i], q_[2][i], q_[3][i]));
+		}
+
+		//! c-th component of the translations (0: x, 1: y, 2: z)
+		double* t(int c) { return &t_[c][0]; }
+		const double* t(int c) const { return &t_[c][0]; }
+
+		//! c-th component of the quaternions (0: w, 1: x, 2: y, 3: z)
+		double* q(int c) { return &q_[c][0]; }
+		const double* q(int c) const { return &q_[c][0]; }
+
+	private:
+		std::vector<double> t_[3];
+		std::vector<double> q_[4];
+	};
+
+	//! Batched slerp over quaternions stored as four component arrays (w, x, y, z)
+	//! Computes out[i] = slerp(q0[i], q1[i], alpha) for i in [0, n)
+	//!
+	//! Uses the corrected nlerp approximation of slerp (nlerp with a cubic
+	//! correction of alpha, see "Approximating slerp" by A. Kapoulkine).
+	//! Its angular error is below 0.005 degrees for keyframes up to 90 degrees apart
+	//! (0.05 degrees in the worst case), and unlike pow() it needs no atan2/sin/cos
+	//! per node, so the whole loop is branch-free and vectorizes.
+	inline void slerpBatch(const double* const q0[4], const double* const q1[4], int n,
+		const double alpha, double* const out[4]) {
+		const double* aw = q0[0];
+		const double* ax = q0[1];
+		const double* ay = q0[2];
+		const double* az = q0[3];
+		const double* bw = q1[0];
+		const double* bx = q1[1];
+		const double* by = q1[2];
+		const double* bz = q1[3];
+		double* rw = out[0];
+		double* rx = out[1];
+		double* ry = out[2];
+		double* rz = out[3];
+
+		for (int i = 0; i < n; ++i) {
+			const double cosine = aw[i] * bw[i] + ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i];
+			const double d = std::abs(cosine);
+
+			// take the shorter arc, same as negating q1 * inv(q0) in slerp
+			const double sign = cosine < 0 ? -1.0 : 1.0;
+
+			const double k0 = 1.0904 + d * (-3.2452 + d * (3.55645 - d * 1.43519));
+			const double k1 = 0.848013 + d * (-1.06021 + d * 0.215638);
+			const double k = k0 * (alpha - 0.5) * (alpha - 0.5) + k1;
+			const double beta = alpha + alpha * (alpha - 0.5) * (alpha - 1) * k;
+
+			const double s0 = 1 - beta;
+			const double s1 = beta * sign;
+
+			const double w = aw[i] * s0 + bw[i] * s1;
+			const double x = ax[i] * s0 + bx[i] * s1;
+			const double y = ay[i] * s0 + by[i] * s1;
+			const double z = az[i] * s0 + bz[i] * s1;
+			const double invNorm = 1.0 / std::sqrt(w * w + x * x + y * y + z * z);
+
+			rw[i] = w * invNorm;
+			rx[i] = x * invNorm;
+			ry[i] = y * invNorm;
+			rz[i] = z * invNorm;
+		}
+	}
+
+	//! Batched version of Linear
+	//! Interpolates the n consecutive nodes starting at index i0 of src0 and at index i1 of src1,
+	//! and writes the result to the first n nodes of out (which must hold at least n nodes)
+	inline void linearBatch(const RigTFormArray& src0, int i0, const RigTFormArray& src1, int i1,
+		int n, const double alpha, RigTFormArray& out) {
+		assert(out.size() >= n);
+
+		for (int c = 0; c < 3; ++c) {
+			const double* a = src0.t(c) + i0;
+			const double* b = src1.t(c) + i1;
+			double* r = out.t(c);
+			for (int i = 0; i < n; ++i) {
+				r[i] = a[i] + (b[i] - a[i]) * alpha;
+			}
+		}
+
+		const double* const q0[4] = { src0.q(0) + i0, src0.q(1) + i0, src0.q(2) + i0, src0.q(3) + i0 };
+		const double* const q1[4] = { src1.q(0) + i1, src1.q(1) + i1, src1.q(2) + i1, src1.q(3) + i1 };
+		double* const r[4] = { out.q(0), out.q(1), out.q(2), out.q(3) };
+		slerpBatch(q0, q1, n, alpha, r);
+	}
+
+	//! Catmull-Rom interpolation of a sequence of keyframes, each holding
+	//! numRbts nodes, stored back to back in a RigTFormArray
+	//!
+	//! Segment s interpolates between keyframes s + 1 and s + 2, using
+	//! keyframes s and s + 3 as neighbours. The Bezier control points of a
+	//! segment are computed the first time it is evaluated and cached until
+	//! reset() is called, which must happen whenever the keyframes change.
+	//! Translations are cached as cubic polynomial coefficients evaluated with
+	//! Horner's rule, rotations as Bezier control quaternions evaluated with
+	//! de Casteljau's algorithm on top of slerpBatch.
+	class CatmullRomSpline {
+	public:
+		CatmullRomSpline() : numRbts_(0) {}
+
+		//! Drop all cached segments and prepare for numSegments segments
+		void reset(int numSegments, int numRbts) {
+			numRbts_ = numRbts;
+			valid_.assign(numSegments, 0);
+			for (int k = 0; k < 4; ++k)
+				for (int c = 0; c < 3; ++c)
+					tCoef_[k][c].resize(numSegments * numRbts);
+			for (int c = 0; c < 4; ++c) {
+				qd_[c].resize(numSegments * numRbts);
+				qe_[c].resize(numSegments * numRbts);
+			}
+			for (int l = 0; l < 5; ++l)
+				for (int c = 0; c < 4; ++c)
+					scratch_[l][c].resize(numRbts);
+		}
+
+		int numSegments() const {
+			return static_cast<int>(valid_.size());
+		}
+
+		//! Evaluate segment s of keys at alpha in [0, 1] into the first numRbts nodes of out
+		void evaluate(const RigTFormArray& keys, int s, const double alpha, RigTFormArray& out) {
+			assert(s >= 0 && s < numSegments() && out.size() >= numRbts_);
+			if (!valid_[s]) {
+				buildSegment(keys, s);
+			}
+
+			const int base = s * numRbts_;
+			for (int c = 0; c < 3; ++c) {
+				const double* a0 = &tCoef_[0][c][base];
+				const double* a1 = &tCoef_[1][c][base];
+				const double* a2 = &tCoef_[2][c][base];
+				const double* a3 = &tCoef_[3][c][base];
+				double* r = out.t(c);
+				for (int i = 0; i < numRbts_; ++i) {
+					r[i] = a0[i] + alpha * (a1[i] + alpha * (a2[i] + alpha * a3[i]));
+				}
+			}
+
+			// de Casteljau: c, d, e, c' -> f, g, h -> m, n -> result
+			const int k1 = (s + 1) * numRbts_;
+			const int k2 = (s + 2) * numRbts_;
+			const double* const c1[4] = { keys.q(0) + k1, keys.q(1) + k1, keys.q(2) + k1, keys.q(3) + k1 };
+			const double* const c2[4] = { keys.q(0) + k2, keys.q(1) + k2, keys.q(2) + k2, keys.q(3) + k2 };
+			const double* const d[4] = { &qd_[0][base], &qd_[1][base], &qd_[2][base], &qd_[3][base] };
+			const double* const e[4] = { &qe_[0][base], &qe_[1][base], &qe_[2][base], &qe_[3][base] };
+			double* const f[4] = { &scratch_[0][0][0], &scratch_[0][1][0], &scratch_[0][2][0], &scratch_[0][3][0] };
+			double* const g[4] = { &scratch_[1][0][0], &scratch_[1][1][0], &scratch_[1][2][0], &scratch_[1][3][0] };
+			double* const h[4] = { &scratch_[2][0][0], &scratch_[2][1][0], &scratch_[2][2][0], &scratch_[2][3][0] };
+			double* const m[4] = { &scratch_[3][0][0], &scratch_[3][1][0], &scratch_[3][2][0], &scratch_[3][3][0] };
+			double* const n[4] = { &scratch_[4][0][0], &scratch_[4][1][0], &scratch_[4][2][0], &scratch_[4][3][0] };
+			double* const r[4] = { out.q(0), out.q(1), out.q(2), out.q(3) };
+
+			slerpBatch(c1, d, numRbts_, alpha, f);
+			slerpBatch(d, e, numRbts_, alpha, g);
+			slerpBatch(e, c2, numRbts_, alpha, h);
+			slerpBatch(f, g, numRbts_, alpha, m);
+			slerpBatch(g, h, numRbts_, alpha, n);
+			slerpBatch(m, n, numRbts_, alpha, r);
+		}
+
+	private:
+		void buildSegment(const RigTFormArray& keys, int s) {
+			const int base = s * numRbts_;
+			for (int i = 0; i < numRbts_; ++i) {
+				const RigTForm k0 = keys.get(s * numRbts_ + i);
+				const RigTForm k1 = keys.get((s + 1) * numRbts_ + i);
+				const RigTForm k2 = keys.get((s + 2) * numRbts_ + i);
+				const RigTForm k3 = keys.get((s + 3) * numRbts_ + i);
+
+				Cvec3 d, e;
+				const Cvec3 c1 = k1.getTranslation(), c2 = k2.getTranslation();
+				catmullRomControlPoints(k0.getTranslation(), c1, c2, k3.getTranslation(), d, e);
+
+				// power basis of the Bezier curve (c1, d, e, c2)
+				const Cvec3 a1 = (d - c1) * 3;
+				const Cvec3 a2 = (c1 - d * 2 + e) * 3;
+				const Cvec3 a3 = c2 - c1 + (d - e) * 3;
+				for (int c = 0; c < 3; ++c) {
+					tCoef_[0][c][base + i] = c1[c];
+					tCoef_[1][c][base + i] = a1[c];
+					tCoef_[2][c][base + i] = a2[c];
+					tCoef_[3][c][base + i] = a3[c];
+				}
+
+				Quat qd, qe;
+				catmullRomControlPoints(k0.getRotation(), k1.getRotation(), k2.getRotation(), k3.getRotation(), qd, qe);
+				for (int c = 0; c < 4; ++c) {
+					qd_[c][base + i] = qd[c];
+					qe_[c][base + i] = qe[c];
+				}
+			}
+			valid_[s] = 1;
+		}
+
+		int numRbts_;
+		std::vector<char> valid_;                // valid_[s] != 0 iff segment s is cached
+		std::vector<double> tCoef_[4][3];        // tCoef_[k][c]: coefficient of alpha^k, component c
+		std::vector<double> qd_[4], qe_[4];      // rotation control points
+		std::vector<double> scratch_[5][4];      // intermediate quaternions of de Casteljau
+	};
 }
 #endif
\ No newline at end of file
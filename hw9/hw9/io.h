@@ -1,11 +1,29 @@
 #ifndef IO_H
 #define IO_H
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <sstream>
 #include <vector>
 #include <iterator>
 
+#ifdef _WIN32
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	ifndef WIN32_LEAN_AND_MEAN
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
 //! Utility function working similarily as
 //! 'split' method in Python
 template <typename T>
@@ -21,4 +39,136 @@ std::vector<T> split(const std::string& str, const char delim) {
 
 	return result;
 }
+
+//! Little-endian encoding helpers for binary files
+//! Values are assembled byte by byte, so the result does not depend on the
+//! byte order of the host (compilers turn these into plain loads/stores on x86)
+inline void putLE16(unsigned char* p, uint16_t v) {
+	p[0] = static_cast<unsigned char>(v);
+	p[1] = static_cast<unsigned char>(v >> 8);
+}
+
+inline void putLE32(unsigned char* p, uint32_t v) {
+	for (int i = 0; i < 4; ++i) {
+		p[i] = static_cast<unsigned char>(v >> (8 * i));
+	}
+}
+
+inline void putLE64(unsigned char* p, uint64_t v) {
+	for (int i = 0; i < 8; ++i) {
+		p[i] = static_cast<unsigned char>(v >> (8 * i));
+	}
+}
+
+inline void putLEDouble(unsigned char* p, double d) {
+	uint64_t bits;
+	std::memcpy(&bits, &d, sizeof(bits));
+	putLE64(p, bits);
+}
+
+inline uint16_t getLE16(const unsigned char* p) {
+	return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t getLE32(const unsigned char* p) {
+	uint32_t v = 0;
+	for (int i = 0; i < 4; ++i) {
+		v |= static_cast<uint32_t>(p[i]) << (8 * i);
+	}
+	return v;
+}
+
+inline uint64_t getLE64(const unsigned char* p) {
+	uint64_t v = 0;
+	for (int i = 0; i < 8; ++i) {
+		v |= static_cast<uint64_t>(p[i]) << (8 * i);
+	}
+	return v;
+}
+
+inline double getLEDouble(const unsigned char* p) {
+	const uint64_t bits = getLE64(p);
+	double d;
+	std::memcpy(&d, &bits, sizeof(d));
+	return d;
+}
+
+//! Read-only memory mapping of a whole file
+//! The file content is accessible through data() as long as the object lives.
+//! If the file cannot be opened or mapped, isOpen() returns false
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& filename) : data_(NULL), size_(0) {
+#ifdef _WIN32
+		file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		mapping_ = NULL;
+		if (file_ == INVALID_HANDLE_VALUE)
+			return;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0)
+			return;
+		mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping_ == NULL)
+			return;
+		void* view = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+		if (view == NULL)
+			return;
+		data_ = static_cast<const unsigned char*>(view);
+		size_ = static_cast<std::size_t>(size.QuadPart);
+#else
+		fd_ = open(filename.c_str(), O_RDONLY);
+		if (fd_ < 0)
+			return;
+		struct stat st;
+		if (fstat(fd_, &st) != 0 || st.st_size == 0)
+			return;
+		void* view = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+		if (view == MAP_FAILED)
+			return;
+		data_ = static_cast<const unsigned char*>(view);
+		size_ = static_cast<std::size_t>(st.st_size);
+#endif
+	}
+
+	~MappedFile() {
+#ifdef _WIN32
+		if (data_ != NULL)
+			UnmapViewOfFile(data_);
+		if (mapping_ != NULL)
+			CloseHandle(mapping_);
+		if (file_ != INVALID_HANDLE_VALUE)
+			CloseHandle(file_);
+#else
+		if (data_ != NULL)
+			munmap(const_cast<unsigned char*>(data_), size_);
+		if (fd_ >= 0)
+			close(fd_);
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator = (const MappedFile&) = delete;
+
+	bool isOpen() const {
+		return data_ != NULL;
+	}
+
+	const unsigned char* data() const {
+		return data_;
+	}
+
+	std::size_t size() const {
+		return size_;
+	}
+
+private:
+	const unsigned char* data_;
+	std::size_t size_;
+#ifdef _WIN32
+	HANDLE file_;
+	HANDLE mapping_;
+#else
+	int fd_;
+#endif
+};
 #endif
\ No newline at end of file
@@ -0,0 +1,317 @@
+#ifndef KEYFRAMECOMPRESSION_H
+#define KEYFRAMECOMPRESSION_H
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "interpolation.h"
+#include "io.h"
+#include "rigtform.h"
+
+//! Compact encoding of keyframe sequences
+//!
+//! Three independent steps shrink the 56 bytes a RigTForm takes in a raw frame:
+//!   - rotations are stored as "smallest three": the index of the largest
+//!     quaternion component (2 bits) and the other three components quantized
+//!     to 15 bits each, 6 bytes in total. The dropped component is recovered
+//!     from the unit length constraint
+//!   - translations are quantized to a fixed step and stored as zigzag varint
+//!     deltas from the same node in the previous stored key
+//!   - optionally, keys that linear interpolation between their stored
+//!     neighbours reproduces within a tolerance are dropped altogether
+//!
+//! Stored keys are at most MAX_KEY_GAP frames apart, so the size of a stream
+//! bounds the number of frames it can expand to and decompress() can reject
+//! a corrupt frame count before allocating the frames.
+//!
+//! The stream is decoded strictly front to back (see Decoder), so it can be
+//! expanded one key at a time during playback.
+namespace KeyframeCompression {
+
+	typedef std::vector<RigTForm> Frame;
+
+	static const int QUAT_BITS = 15;
+	static const int QUAT_SIZE = 6;    // bytes per quantized quaternion
+	static const int MIN_RBT_SIZE = 3 + QUAT_SIZE;    // bytes per RigTForm at least: three one-byte varints
+	static const int MAX_KEY_GAP = 256;    // most frames from one stored key to the next
+	static const double MAX_QUANTIZED = 4503599627370496.0;    // 2^52, larger quantized translations are clamped
+
+	struct Settings {
+		double translationStep;      // quantization step of translations
+		double translationTolerance; // max. position error of dropped keys, 0 keeps every key
+		double rotationTolerance;    // max. angle (radians) of dropped keys, 0 keeps every key
+
+		Settings() : translationStep(1e-4), translationTolerance(0), rotationTolerance(0) {}
+	};
+
+	//! A compressed keyframe sequence
+	struct Stream {
+		uint32_t numFrames;    // number of frames before key reduction
+		uint32_t numRbts;
+		uint32_t numKeys;      // number of stored keys
+		double translationStep;
+		std::vector<unsigned char> bytes;
+
+		Stream() : numFrames(0), numRbts(0), numKeys(0), translationStep(1) {}
+	};
+
+	inline void putVarint(std::vector<unsigned char>& out, uint64_t v) {
+		while (v >= 0x80) {
+			out.push_back(static_cast<unsigned char>(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back(static_cast<unsigned char>(v));
+	}
+
+	//! Reads a varint at p, returns false if it runs past end
+	inline bool getVarint(const unsigned char*& p, const unsigned char* end, uint64_t& v) {
+		v = 0;
+		for (int shift = 0; shift < 64 && p < end; shift += 7) {
+			const unsigned char b = *p++;
+			v |= static_cast<uint64_t>(b & 0x7f) << shift;
+			if (!(b & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	inline uint64_t zigzag(int64_t v) {
+		return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+	}
+
+	inline int64_t unzigzag(uint64_t v) {
+		return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+	}
+
+	//! Translation component x in multiples of step, rounded
+	//! Clamped to +-MAX_QUANTIZED so that it converts to int64_t, 0 for NaN
+	inline int64_t quantize(double x, double step) {
+		const double q = std::floor(x / step + 0.5);
+		if (q != q)
+			return 0;
+		return static_cast<int64_t>(std::min(std::max(q, -MAX_QUANTIZED), MAX_QUANTIZED));
+	}
+
+	//! Smallest-three encoding of a (normalized) quaternion into 6 bytes
+	inline void encodeQuat(const Quat& rot, unsigned char* p) {
+		Quat q = normalize(rot);
+
+		int largest = 0;
+		for (int c = 1; c < 4; ++c) {
+			if (std::abs(q[c]) > std::abs(q[largest]))
+				largest = c;
+		}
+		if (q[largest] < 0)
+			q *= -1;    // q and -q are the same rotation, make the dropped component positive
+
+		// the remaining components lie in [-1/sqrt(2), 1/sqrt(2)]
+		const double range = 1.0 / std::sqrt(2.0);
+		const double scale = ((1 << QUAT_BITS) - 1) / (2 * range);
+		uint64_t bits = largest;
+		for (int c = 0, k = 0; c < 4; ++c) {
+			if (c == largest)
+				continue;
+			double v = std::floor((q[c] + range) * scale + 0.5);
+			v = v > 0 ? (v < (1 << QUAT_BITS) - 1 ? v : (1 << QUAT_BITS) - 1) : 0;    // NaN gives 0
+			bits |= static_cast<uint64_t>(v) << (2 + QUAT_BITS * k++);
+		}
+		for (int i = 0; i < QUAT_SIZE; ++i)
+			p[i] = static_cast<unsigned char>(bits >> (8 * i));
+	}
+
+	inline Quat decodeQuat(const unsigned char* p) {
+		uint64_t bits = 0;
+		for (int i = 0; i < QUAT_SIZE; ++i)
+			bits |= static_cast<uint64_t>(p[i]) << (8 * i);
+
+		const int largest = static_cast<int>(bits & 3);
+		const double range = 1.0 / std::sqrt(2.0);
+		const double scale = 2 * range / ((1 << QUAT_BITS) - 1);
+		const uint64_t mask = (1 << QUAT_BITS) - 1;
+
+		Quat q;
+		double sum = 0;
+		for (int c = 0, k = 0; c < 4; ++c) {
+			if (c == largest)
+				continue;
+			q[c] = ((bits >> (2 + QUAT_BITS * k++)) & mask) * scale - range;
+			sum += q[c] * q[c];
+		}
+		q[largest] = std::sqrt(sum < 1 ? 1 - sum : 0);
+		return q;
+	}
+
+	//! Indices of the frames that have to be stored so that linear interpolation
+	//! reproduces every other frame within the tolerances of settings
+	//! The first and the last frame are always kept, and keys are at most MAX_KEY_GAP apart
+	inline std::vector<int> selectKeys(const std::vector<Frame>& frames, const Settings& settings) {
+		const int n = static_cast<int>(frames.size());
+		std::vector<int> keys;
+		if (n == 0)
+			return keys;
+
+		const bool reduce = settings.translationTolerance > 0 && settings.rotationTolerance > 0;
+		const double cosHalfTol = std::cos(settings.rotationTolerance / 2);
+
+		// whether all frames strictly between a and b are reproduced by interpolating a and b
+		auto spanFits = [&](int a, int b) {
+			for (int f = a + 1; f < b; ++f) {
+				const double alpha = double(f - a) / (b - a);
+				for (std::size_t i = 0; i < frames[f].size(); ++i) {
+					const RigTForm rbt = Interpolation::Linear(frames[a][i], frames[b][i], alpha);
+					const Cvec3 dt = rbt.getTranslation() - frames[f][i].getTranslation();
+					if (norm2(dt) > settings.translationTolerance * settings.translationTolerance)
+						return false;
+					if (std::abs(dot(rbt.getRotation(), frames[f][i].getRotation())) < cosHalfTol)
+						return false;
+				}
+			}
+			return true;
+		};
+
+		int anchor = 0;
+		keys.push_back(0);
+		while (anchor < n - 1) {
+			int next = anchor + 1;
+			if (reduce) {
+				while (next + 1 < n && next + 1 - anchor <= MAX_KEY_GAP && spanFits(anchor, next + 1))
+					++next;
+			}
+			keys.push_back(next);
+			anchor = next;
+		}
+		return keys;
+	}
+
+	//! Compress frames, which must all hold the same number of RigTForms
+	//! Translations beyond +-MAX_QUANTIZED steps are clamped, NaN ones stored as 0
+	inline Stream compress(const std::vector<Frame>& frames, const Settings& settings = Settings()) {
+		assert(settings.translationStep > 0);
+		Stream stream;
+		stream.numFrames = static_cast<uint32_t>(frames.size());
+		stream.numRbts = frames.empty() ? 0 : static_cast<uint32_t>(frames[0].size());
+		stream.translationStep = settings.translationStep;
+
+		const std::vector<int> keys = selectKeys(frames, settings);
+		stream.numKeys = static_cast<uint32_t>(keys.size());
+
+		std::vector<int64_t> prev(3 * stream.numRbts, 0);
+		unsigned char quat[QUAT_SIZE];
+		int prevKey = 0;
+		for (std::size_t k = 0; k < keys.size(); ++k) {
+			const Frame& frame = frames[keys[k]];
+			putVarint(stream.bytes, keys[k] - prevKey);
+			prevKey = keys[k];
+
+			for (uint32_t i = 0; i < stream.numRbts; ++i) {
+				const Cvec3 t = frame[i].getTranslation();
+				for (int c = 0; c < 3; ++c) {
+					const int64_t v = quantize(t[c], settings.translationStep);
+					putVarint(stream.bytes, zigzag(v - prev[3 * i + c]));
+					prev[3 * i + c] = v;
+				}
+				encodeQuat(frame[i].getRotation(), quat);
+				stream.bytes.insert(stream.bytes.end(), quat, quat + QUAT_SIZE);
+			}
+		}
+		return stream;
+	}
+
+	//! Sequential reader of the keys stored in a compressed stream
+	class Decoder {
+	public:
+		//! A key with more RigTForms than size can hold is corrupt, so the state
+		//! is only allocated up to that bound
+		Decoder(const unsigned char* data, std::size_t size, uint32_t numRbts, double translationStep)
+			: p_(data), end_(data + size), numRbts_(numRbts), step_(translationStep),
+			frameIdx_(0), prev_(3 * std::min<std::size_t>(numRbts, size / MIN_RBT_SIZE), 0) {}
+
+		//! Decode the next stored key into frame and its original index into frameIdx
+		//! Returns false at the end of the stream or if the data is corrupt
+		bool next(int& frameIdx, Frame& frame) {
+			uint64_t v;
+			if (numRbts_ > static_cast<std::size_t>(end_ - p_) / MIN_RBT_SIZE || !getVarint(p_, end_, v))
+				return false;
+			if (v > static_cast<uint64_t>(INT_MAX - frameIdx_))
+				return false;
+			frameIdx_ += static_cast<int>(v);
+			frameIdx = frameIdx_;
+
+			frame.resize(numRbts_);
+			for (uint32_t i = 0; i < numRbts_; ++i) {
+				Cvec3 t;
+				for (int c = 0; c < 3; ++c) {
+					if (!getVarint(p_, end_, v))
+						return false;
+					// wraps around instead of overflowing on corrupt deltas
+					prev_[3 * i + c] = static_cast<int64_t>(static_cast<uint64_t>(prev_[3 * i + c]) + static_cast<uint64_t>(unzigzag(v)));
+					t[c] = prev_[3 * i + c] * step_;
+				}
+				if (end_ - p_ < QUAT_SIZE)
+					return false;
+				frame[i] = RigTForm(t, decodeQuat(p_));
+				p_ += QUAT_SIZE;
+			}
+			return true;
+		}
+
+	private:
+		const unsigned char* p_;
+		const unsigned char* end_;
+		uint32_t numRbts_;
+		double step_;
+		int frameIdx_;
+		std::vector<int64_t> prev_;
+	};
+
+	//! Expand a compressed stream back into stream.numFrames frames,
+	//! interpolating the frames that were dropped by the key reduction
+	//! Returns false if the data is corrupt
+	inline bool decompress(const unsigned char* data, std::size_t size, uint32_t numFrames, uint32_t numRbts,
+		double translationStep, std::vector<Frame>& frames) {
+		// every key takes at least one byte for its index and MIN_RBT_SIZE per RigTForm
+		const uint64_t maxKeys = size / (1 + static_cast<uint64_t>(numRbts) * MIN_RBT_SIZE);
+		if (numFrames > 0 && (maxKeys == 0 || numFrames - 1 > (maxKeys - 1) * MAX_KEY_GAP)) {
+			std::cerr << "Compressed keyframe data is truncated!\n";
+			return false;
+		}
+		frames.resize(numFrames);
+
+		Decoder decoder(data, size, numRbts, translationStep);
+		int prevIdx = -1;
+		int idx;
+		Frame key;
+		while (decoder.next(idx, key)) {
+			if (idx >= static_cast<int>(numFrames) || idx <= prevIdx || idx - prevIdx > MAX_KEY_GAP)
+				break;
+			if (prevIdx < 0 && idx != 0)
+				break;    // the first frame has to be stored
+			for (int f = prevIdx + 1; f < idx && prevIdx >= 0; ++f) {
+				const double alpha = double(f - prevIdx) / (idx - prevIdx);
+				frames[f].resize(numRbts);
+				for (uint32_t i = 0; i < numRbts; ++i)
+					frames[f][i] = Interpolation::Linear(frames[prevIdx][i], key[i], alpha);
+			}
+			frames[idx] = key;
+			prevIdx = idx;
+		}
+
+		if (prevIdx != static_cast<int>(numFrames) - 1) {
+			std::cerr << "Compressed keyframe data is corrupt!\n";
+			return false;
+		}
+		return true;
+	}
+
+	inline bool decompress(const Stream& stream, std::vector<Frame>& frames) {
+		return decompress(stream.bytes.empty() ? NULL : &stream.bytes[0], stream.bytes.size(),
+			stream.numFrames, stream.numRbts, stream.translationStep, frames);
+	}
+}
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef KEYFRAMEFILE_H
+#define KEYFRAMEFILE_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "io.h"
+#include "keyframecompression.h"
+#include "rigtform.h"
+
+//! Binary container for keyframe animations
+//!
+//! All values are little-endian. The layout is
+//!
+//!   offset  size  content
+//!   0       4     magic "KFRM"
+//!   4       2     format version (VERSION)
+//!   6       2     flags (FLAG_COMPRESSED, FLAG_TIMESTAMPS)
+//!   8       4     number of frames
+//!   12      4     number of RigTForms per frame
+//!   16      ...   payload: frames, back to back. Each RigTForm is 7 doubles:
+//!                 translation x, y, z followed by quaternion w, x, y, z
+//!
+//! With FLAG_COMPRESSED the frames are replaced by (offsets relative to the payload)
+//!   0       8     translation quantization step (double)
+//!   8       4     number of stored keys
+//!   12      4     size of the key stream in bytes
+//!   16      ...   key stream, see keyframecompression.h
+//!
+//! With FLAG_TIMESTAMPS the time of every frame (one double each, ascending)
+//! sits between the header and the payload. Without it, frames are one time unit apart.
+//!
+//! Readers reject files with a newer version or unknown flags.
+namespace KeyframeFile {
+
+	static const char MAGIC[4] = { 'K', 'F', 'R', 'M' };
+	static const uint16_t VERSION = 1;
+	static const int HEADER_SIZE = 16;
+	static const int RBT_SIZE = 7 * 8;    // bytes per RigTForm
+	static const int COMPRESSED_HEADER_SIZE = 16;    // bytes between the header and the key stream
+
+	static const uint16_t FLAG_COMPRESSED = 1;
+	static const uint16_t FLAG_TIMESTAMPS = 2;
+
+	struct Header {
+		uint16_t version;
+		uint16_t flags;
+		uint32_t numFrames;
+		uint32_t numRbts;
+	};
+
+	//! Returns true if the buffer starts with the keyframe file magic
+	inline bool hasMagic(const unsigned char* data, std::size_t size) {
+		return size >= 4 && std::memcmp(data, MAGIC, 4) == 0;
+	}
+
+	inline void encodeHeader(const Header& header, unsigned char* p) {
+		std::memcpy(p, MAGIC, 4);
+		putLE16(p + 4, header.version);
+		putLE16(p + 6, header.flags);
+		putLE32(p + 8, header.numFrames);
+		putLE32(p + 12, header.numRbts);
+	}
+
+	//! Offset of the payload from the beginning of the file
+	inline std::size_t payloadOffset(const Header& header) {
+		return HEADER_SIZE + ((header.flags & FLAG_TIMESTAMPS) ? static_cast<std::size_t>(header.numFrames) * 8 : 0);
+	}
+
+	//! Decode and validate the header at the beginning of a file of the given size
+	//! Returns false (and prints the reason) if the file is not a readable keyframe file
+	inline bool decodeHeader(const unsigned char* data, std::size_t size, Header& header) {
+		if (size < static_cast<std::size_t>(HEADER_SIZE) || !hasMagic(data, size)) {
+			std::cerr << "Not a keyframe file!\n";
+			return false;
+		}
+		header.version = getLE16(data + 4);
+		header.flags = getLE16(data + 6);
+		header.numFrames = getLE32(data + 8);
+		header.numRbts = getLE32(data + 12);
+
+		if (header.version > VERSION || (header.flags & ~(FLAG_COMPRESSED | FLAG_TIMESTAMPS)) != 0) {
+			std::cerr << "Unsupported keyframe file (version " << header.version << ", flags " << header.flags << ")\n";
+			return false;
+		}
+		const uint64_t payload = (header.flags & FLAG_COMPRESSED)
+			? COMPRESSED_HEADER_SIZE
+			: static_cast<uint64_t>(header.numFrames) * header.numRbts * RBT_SIZE;
+		const uint64_t times = (header.flags & FLAG_TIMESTAMPS) ? static_cast<uint64_t>(header.numFrames) * 8 : 0;
+		if (header.numFrames == 0 || header.numRbts == 0 || size - HEADER_SIZE < times + payload) {
+			std::cerr << "Keyframe file is truncated or empty!\n";
+			return false;
+		}
+		return true;
+	}
+
+	inline void encodeRbt(const RigTForm& rbt, unsigned char* p) {
+		const Cvec3 t = rbt.getTranslation();
+		const Quat q = rbt.getRotation();
+		for (int c = 0; c < 3; ++c)
+			putLEDouble(p + 8 * c, t[c]);
+		for (int c = 0; c < 4; ++c)
+			putLEDouble(p + 24 + 8 * c, q[c]);
+	}
+
+	inline RigTForm decodeRbt(const unsigned char* p) {
+		return RigTForm(Cvec3(getLEDouble(p), getLEDouble(p + 8), getLEDouble(p + 16)),
+			Quat(getLEDouble(p + 24), getLEDouble(p + 32), getLEDouble(p + 40), getLEDouble(p + 48)));
+	}
+
+	//! Decode one frame of numRbts RigTForms starting at p into frame
+	inline void decodeFrame(const unsigned char* p, int numRbts, std::vector<RigTForm>& frame) {
+		frame.resize(numRbts);
+		for (int i = 0; i < numRbts; ++i, p += RBT_SIZE) {
+			frame[i] = decodeRbt(p);
+		}
+	}
+
+	inline bool writeBuffer(const std::string& filename, const std::vector<unsigned char>& buffer) {
+		std::ofstream file(filename, std::ios::binary);
+		if (!file.write(reinterpret_cast<const char*>(&buffer[0]), buffer.size())) {
+			std::cerr << "Cannot write " << filename << "\n";
+			return false;
+		}
+		return true;
+	}
+
+	//! Allocate buffer for header followed by the optional frame times and payloadSize bytes,
+	//! fill in everything but the payload and return the offset of the payload
+	inline std::size_t beginBuffer(Header& header, const std::vector<double>* times, std::size_t payloadSize,
+		std::vector<unsigned char>& buffer) {
+		if (times) {
+			assert(times->size() == header.numFrames);
+			header.flags |= FLAG_TIMESTAMPS;
+		}
+		const std::size_t offset = payloadOffset(header);
+		buffer.resize(offset + payloadSize);
+		encodeHeader(header, &buffer[0]);
+		for (uint32_t f = 0; times && f < header.numFrames; ++f)
+			putLEDouble(&buffer[HEADER_SIZE + 8 * f], (*times)[f]);
+		return offset;
+	}
+
+	//! Write frames (and their times, if given) to filename, returns false on failure
+	//! All frames must hold the same number of RigTForms
+	inline bool write(const std::string& filename, const std::vector<std::vector<RigTForm> >& frames,
+		const std::vector<double>* times = NULL) {
+		if (frames.empty()) {
+			std::cerr << "There's no keyframe to write!\n";
+			return false;
+		}
+
+		Header header;
+		header.version = VERSION;
+		header.flags = 0;
+		header.numFrames = static_cast<uint32_t>(frames.size());
+		header.numRbts = static_cast<uint32_t>(frames[0].size());
+
+		std::vector<unsigned char> buffer;
+		const std::size_t offset = beginBuffer(header, times,
+			static_cast<std::size_t>(header.numFrames) * header.numRbts * RBT_SIZE, buffer);
+
+		unsigned char* p = &buffer[offset];
+		for (std::size_t f = 0; f < frames.size(); ++f) {
+			assert(frames[f].size() == header.numRbts);
+			for (std::size_t i = 0; i < frames[f].size(); ++i) {
+				encodeRbt(frames[f][i], p);
+				p += RBT_SIZE;
+			}
+		}
+
+		return writeBuffer(filename, buffer);
+	}
+
+	//! Write frames to filename in compressed form, returns false on failure
+	inline bool writeCompressed(const std::string& filename, const std::vector<std::vector<RigTForm> >& frames,
+		const KeyframeCompression::Settings& settings = KeyframeCompression::Settings(),
+		const std::vector<double>* times = NULL) {
+		if (frames.empty()) {
+			std::cerr << "There's no keyframe to write!\n";
+			return false;
+		}
+
+		const KeyframeCompression::Stream stream = KeyframeCompression::compress(frames, settings);
+
+		Header header;
+		header.version = VERSION;
+		header.flags = FLAG_COMPRESSED;
+		header.numFrames = stream.numFrames;
+		header.numRbts = stream.numRbts;
+
+		std::vector<unsigned char> buffer;
+		const std::size_t offset = beginBuffer(header, times, COMPRESSED_HEADER_SIZE + stream.bytes.size(), buffer);
+		putLEDouble(&buffer[offset], stream.translationStep);
+		putLE32(&buffer[offset + 8], stream.numKeys);
+		putLE32(&buffer[offset + 12], static_cast<uint32_t>(stream.bytes.size()));
+		std::copy(stream.bytes.begin(), stream.bytes.end(), buffer.begin() + offset + COMPRESSED_HEADER_SIZE);
+
+		std::cout << "Stored " << stream.numKeys << " of " << stream.numFrames << " keyframes in "
+			<< buffer.size() << " bytes (raw: " << HEADER_SIZE + static_cast<uint64_t>(stream.numFrames) * stream.numRbts * RBT_SIZE << ")\n";
+		return writeBuffer(filename, buffer);
+	}
+
+	//! Read the frame times stored after the header into times,
+	//! or make them one unit apart (starting at first) if the file has none
+	//! Returns false if the stored times are not strictly ascending
+	inline bool decodeTimes(const unsigned char* data, const Header& header, double first, std::vector<double>& times) {
+		times.resize(header.numFrames);
+		for (uint32_t f = 0; f < header.numFrames; ++f) {
+			times[f] = (header.flags & FLAG_TIMESTAMPS) ? getLEDouble(data + HEADER_SIZE + 8 * f) : first + f;
+			if (f > 0 && !(times[f] > times[f - 1])) {
+				std::cerr << "Keyframe times are not ascending!\n";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//! Read all frames of a memory mapped keyframe file, returns false on failure
+	//! If times is given, it receives the frame times (see decodeTimes)
+	inline bool read(const MappedFile& file, std::vector<std::vector<RigTForm> >& frames,
+		std::vector<double>* times = NULL, double firstTime = 0) {
+		Header header;
+		if (!file.isOpen() || !decodeHeader(file.data(), file.size(), header))
+			return false;
+
+		// the frames first: their decoding checks the frame count against the file size
+		const std::size_t offset = payloadOffset(header);
+		if (header.flags & FLAG_COMPRESSED) {
+			const unsigned char* p = file.data() + offset;
+			const double step = getLEDouble(p);
+			const uint32_t numBytes = getLE32(p + 12);
+			if (numBytes > file.size() - offset - COMPRESSED_HEADER_SIZE) {
+				std::cerr << "Keyframe file is truncated or empty!\n";
+				return false;
+			}
+			if (!KeyframeCompression::decompress(p + COMPRESSED_HEADER_SIZE, numBytes,
+				header.numFrames, header.numRbts, step, frames))
+				return false;
+		}
+		else {
+			// in size_t like the sizes decodeHeader checked, numRbts * RBT_SIZE can overflow 32 bits
+			const std::size_t frameSize = static_cast<std::size_t>(header.numRbts) * RBT_SIZE;
+			frames.resize(header.numFrames);
+			const unsigned char* p = file.data() + offset;
+			for (uint32_t f = 0; f < header.numFrames; ++f) {
+				decodeFrame(p, header.numRbts, frames[f]);
+				p += frameSize;
+			}
+		}
+
+		return !times || decodeTimes(file.data(), header, firstTime, *times);
+	}
+}
+
+#endif
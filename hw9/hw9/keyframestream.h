@@ -0,0 +1,252 @@
+#ifndef KEYFRAMESTREAM_H
+#define KEYFRAMESTREAM_H
+
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "animation.h"
+#include "interpolation.h"
+#include "keyframefile.h"
+
+namespace Animation {
+
+	//! Plays back a binary keyframe file without loading it as a whole
+	//!
+	//! The file is read in chunks of CHUNK_FRAMES keyframes. Only the chunks
+	//! around the segment being played are kept in memory, and the chunk after
+	//! them is read on a worker thread while the current ones play, so memory
+	//! use is bounded by a few chunks whatever the length of the file.
+	//! Playback is expected to move forward; jumping elsewhere reads the
+	//! needed chunks synchronously.
+	//!
+	//! Only files with raw frames can be streamed, compressed files are
+	//! decoded front to back and have to be imported into a KeyframeList.
+	class KeyframeStream {
+	public:
+		static const int CHUNK_FRAMES = 64;
+
+		KeyframeStream() : payloadOffset_(0), numFrames_(0), numRbts_(0), mode_(LINEAR), segment_(-1) {}
+
+		~KeyframeStream() {
+			close();
+		}
+
+		KeyframeStream(const KeyframeStream&) = delete;
+		KeyframeStream& operator = (const KeyframeStream&) = delete;
+
+		//! Read the header of filename and start loading the first chunks
+		//! Returns false (and prints the reason) if the file cannot be streamed
+		bool open(const std::string& filename) {
+			close();
+
+			std::ifstream file(filename, std::ios::binary);
+			std::vector<unsigned char> header(KeyframeFile::HEADER_SIZE);
+			if (!file.read(reinterpret_cast<char*>(&header[0]), KeyframeFile::HEADER_SIZE)) {
+				std::cerr << "Cannot read " << filename << "\n";
+				return false;
+			}
+			file.seekg(0, std::ios::end);
+			const std::size_t size = static_cast<std::size_t>(file.tellg());
+
+			KeyframeFile::Header h;
+			if (!KeyframeFile::decodeHeader(&header[0], size, h))
+				return false;
+			if (h.flags & KeyframeFile::FLAG_COMPRESSED) {
+				std::cerr << "Compressed keyframe files cannot be streamed, import them instead\n";
+				return false;
+			}
+
+			// the keyframe times (8 bytes per keyframe) stay in memory
+			payloadOffset_ = KeyframeFile::payloadOffset(h);
+			header.resize(payloadOffset_);
+			file.seekg(KeyframeFile::HEADER_SIZE);
+			if (!file.read(reinterpret_cast<char*>(&header[KeyframeFile::HEADER_SIZE]), payloadOffset_ - KeyframeFile::HEADER_SIZE)
+				|| !KeyframeFile::decodeTimes(&header[0], h, -1, times_)) {
+				std::cerr << "Cannot read the keyframe times of " << filename << "\n";
+				return false;
+			}
+
+			filename_ = filename;
+			numFrames_ = static_cast<int>(h.numFrames);
+			numRbts_ = static_cast<int>(h.numRbts);
+			keys_.resize(4 * numRbts_);
+			out_.resize(numRbts_);
+			prefetch(0);
+			prefetch(1);
+			return true;
+		}
+
+		void close() {
+			for (std::map<int, std::future<ChunkPtr> >::iterator it = pending_.begin(); it != pending_.end(); ++it)
+				it->second.wait();
+			pending_.clear();
+			chunks_.clear();
+			times_.clear();
+			numFrames_ = 0;
+			numRbts_ = 0;
+			segment_ = -1;
+		}
+
+		bool isOpen() const {
+			return numFrames_ > 0;
+		}
+
+		//! Number of keyframes in the file
+		int size() const {
+			return numFrames_;
+		}
+
+		//! Number of RigTForms in each keyframe
+		int numRbts() const {
+			return numRbts_;
+		}
+
+		void setInterpolationMode(InterpolationMode mode) {
+			mode_ = mode;
+		}
+
+		//! Number of chunks in memory, including the ones being read
+		int numResidentChunks() const {
+			return static_cast<int>(chunks_.size() + pending_.size());
+		}
+
+		//! Same as KeyframeList::interpolateKeyframes, reading keyframes from the file
+		bool interpolateKeyframes(float t, Frame& interFrame) {
+			int p;
+			double alpha;
+			if (!isOpen() || !cursor_.locate(times_, t, p, alpha)) {
+				return true;
+			}
+
+			// spline segment s = p - 1 uses the keyframes at positions s, ..., s + 3
+			if (p - 1 != segment_ && !loadSegment(p - 1)) {
+				return true;    // the file could not be read, stop the playback
+			}
+
+			// keys_ holds the keyframes at positions s, ..., s + 3 of the file
+			if (mode_ == CATMULL_ROM) {
+				spline_.evaluate(keys_, 0, alpha, out_);
+			}
+			else {
+				Interpolation::linearBatch(keys_, numRbts_, keys_, 2 * numRbts_, numRbts_, alpha, out_);
+			}
+
+			interFrame.resize(numRbts_);
+			for (int i = 0; i < numRbts_; ++i) {
+				interFrame[i] = out_.get(i);
+			}
+			return false;
+		}
+
+	private:
+		typedef std::shared_ptr<const std::vector<Frame> > ChunkPtr;
+
+		//! Gather the four keyframes around segment s, drop the resident and pending
+		//! chunks outside them and start reading the chunk after them.
+		//! Returns false if a read failed
+		bool loadSegment(int s) {
+			for (int k = 0; k < 4; ++k) {
+				const int pos = s + k;
+				const ChunkPtr c = chunk(pos / CHUNK_FRAMES);
+				if (!c)
+					return false;
+				const Frame& frame = (*c)[pos % CHUNK_FRAMES];
+				for (int i = 0; i < numRbts_; ++i) {
+					keys_.set(k * numRbts_ + i, frame[i]);
+				}
+			}
+			spline_.reset(1, numRbts_);
+			segment_ = s;
+
+			const int first = s / CHUNK_FRAMES;
+			const int last = (s + 3) / CHUNK_FRAMES;
+			chunks_.erase(chunks_.begin(), chunks_.lower_bound(first));
+			chunks_.erase(chunks_.upper_bound(last), chunks_.end());
+			// reads started before a jump would otherwise hold their frames until close()
+			for (std::map<int, std::future<ChunkPtr> >::iterator it = pending_.begin(); it != pending_.end();) {
+				if (it->first < first || it->first > last + 1) {
+					it->second.wait();
+					it = pending_.erase(it);
+				}
+				else {
+					++it;
+				}
+			}
+			prefetch(last + 1);
+			return true;
+		}
+
+		//! Chunk c, waiting for it or reading it on the spot if it is not resident
+		//! NULL if it could not be read
+		ChunkPtr chunk(int c) {
+			std::map<int, ChunkPtr>::iterator it = chunks_.find(c);
+			if (it != chunks_.end())
+				return it->second;
+
+			ChunkPtr loaded;
+			std::map<int, std::future<ChunkPtr> >::iterator p = pending_.find(c);
+			if (p != pending_.end()) {
+				loaded = p->second.get();
+				pending_.erase(p);
+			}
+			else {
+				loaded = readChunk(filename_, payloadOffset_, c, numFrames_, numRbts_);
+			}
+			if (loaded)
+				chunks_[c] = loaded;
+			return loaded;
+		}
+
+		//! Start reading chunk c on a worker thread unless it is resident or out of range
+		void prefetch(int c) {
+			if (c * CHUNK_FRAMES >= numFrames_ || chunks_.count(c) || pending_.count(c))
+				return;
+			pending_[c] = std::async(std::launch::async, &KeyframeStream::readChunk,
+				filename_, payloadOffset_, c, numFrames_, numRbts_);
+		}
+
+		static ChunkPtr readChunk(std::string filename, std::size_t payloadOffset, int c, int numFrames, int numRbts) {
+			const int first = c * CHUNK_FRAMES;
+			const int count = std::min(static_cast<int>(CHUNK_FRAMES), numFrames - first);
+			const std::size_t frameSize = static_cast<std::size_t>(numRbts) * KeyframeFile::RBT_SIZE;
+
+			std::vector<unsigned char> buffer(count * frameSize);
+			std::ifstream file(filename, std::ios::binary);
+			file.seekg(payloadOffset + first * frameSize);
+			if (!file.read(reinterpret_cast<char*>(&buffer[0]), buffer.size())) {
+				std::cerr << "Cannot read keyframes " << first << " to " << first + count - 1 << " of " << filename << "\n";
+				return ChunkPtr();
+			}
+
+			std::shared_ptr<std::vector<Frame> > chunk = std::make_shared<std::vector<Frame> >(count);
+			for (int f = 0; f < count; ++f) {
+				KeyframeFile::decodeFrame(&buffer[f * frameSize], numRbts, (*chunk)[f]);
+			}
+			return chunk;
+		}
+
+		std::string filename_;
+		std::size_t payloadOffset_;    // file offset of the first frame
+		std::vector<double> times_;
+		SegmentCursor cursor_;
+		int numFrames_;
+		int numRbts_;
+		InterpolationMode mode_;
+
+		std::map<int, ChunkPtr> chunks_;                  // resident chunks by index
+		std::map<int, std::future<ChunkPtr> > pending_;   // chunks being read
+
+		int segment_;                                     // segment held in keys_, -1 if none
+		Interpolation::RigTFormArray keys_;               // keyframes s, ..., s + 3 of the current segment
+		Interpolation::RigTFormArray out_;
+		Interpolation::CatmullRomSpline spline_;          // single segment spline over keys_
+	};
+}
+
+#endif
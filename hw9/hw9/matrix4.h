@@ -7,34 +7,35 @@
 
 #include "cvec.h"
 
-// Forward declaration of Matrix4 and transpose since those are used below
-class Matrix4;
-Matrix4 transpose(const Matrix4& m);
+// Forward declaration of Matrix4T and transpose since those are used below
+template <typename T> class Matrix4T;
+template <typename T> constexpr Matrix4T<T> transpose(const Matrix4T<T>& m);
 
-// A 4x4 Matrix.
+// A 4x4 Matrix with elements of type T (see the typedefs below).
 // This class follows column-major
 // To get the element at ith row and jth column, use a(i,j)
-class Matrix4 {
-  double d_[16]; // layout is row-major
+template <typename T>
+class Matrix4T {
+  T d_[16]; // layout is row-major
 
 public:
-  double &operator () (const int row, const int col) {
+  constexpr T &operator () (const int row, const int col) {
     return d_[(row << 2) + col];
   }
 
-  const double &operator () (const int row, const int col) const {
+  constexpr const T &operator () (const int row, const int col) const {
     return d_[(row << 2) + col];
   }
 
-  double& operator [] (const int i) {
+  constexpr T& operator [] (const int i) {
     return d_[i];
   }
 
-  const double& operator [] (const int i) const {
+  constexpr const T& operator [] (const int i) const {
     return d_[i];
   }
 
-  Matrix4() {
+  constexpr Matrix4T() : d_() {
     for (int i = 0; i < 16; ++i) {
       d_[i] = 0;
     }
@@ -43,67 +44,75 @@ public:
     }
   }
 
-  Matrix4(const double a) {
+  constexpr Matrix4T(const T a) : d_() {
     for (int i = 0; i < 16; ++i) {
       d_[i] = a;
     }
   }
 
-  template <class T>
-  Matrix4& readFromColumnMajorMatrix(const T m[]) {
+  // conversion between precisions
+  template <typename S>
+  explicit constexpr Matrix4T(const Matrix4T<S>& m) : d_() {
+    for (int i = 0; i < 16; ++i) {
+      d_[i] = T(m[i]);
+    }
+  }
+
+  template <class S>
+  constexpr Matrix4T& readFromColumnMajorMatrix(const S m[]) {
     for (int i = 0; i < 16; ++i) {
       d_[i] = m[i];
     }
     return *this = transpose(*this);
   }
 
-  template <class T>
-  void writeToColumnMajorMatrix(T m[]) const {
-    Matrix4 t = transpose(*this);
+  template <class S>
+  constexpr void writeToColumnMajorMatrix(S m[]) const {
+    Matrix4T t = transpose(*this);
     for (int i = 0; i < 16; ++i) {
-      m[i] = T(t.d_[i]);
+      m[i] = S(t.d_[i]);
     }
   }
 
-  Matrix4& operator += (const Matrix4& m) {
+  constexpr Matrix4T& operator += (const Matrix4T& m) {
     for (int i = 0; i < 16; ++i) {
       d_[i] += m.d_[i];
     }
     return *this;
   }
 
-  Matrix4& operator -= (const Matrix4& m) {
+  constexpr Matrix4T& operator -= (const Matrix4T& m) {
     for (int i = 0; i < 16; ++i) {
       d_[i] -= m.d_[i];
     }
     return *this;
   }
 
-  Matrix4& operator *= (const double a) {
+  constexpr Matrix4T& operator *= (const T a) {
     for (int i = 0; i < 16; ++i) {
       d_[i] *= a;
     }
     return *this;
   }
 
-  Matrix4& operator *= (const Matrix4& a) {
+  constexpr Matrix4T& operator *= (const Matrix4T& a) {
     return *this = *this * a;
   }
 
-  Matrix4 operator + (const Matrix4& a) const {
-    return Matrix4(*this) += a;
+  constexpr Matrix4T operator + (const Matrix4T& a) const {
+    return Matrix4T(*this) += a;
   }
 
-  Matrix4 operator - (const Matrix4& a) const {
-    return Matrix4(*this) -= a;
+  constexpr Matrix4T operator - (const Matrix4T& a) const {
+    return Matrix4T(*this) -= a;
   }
 
-  Matrix4 operator * (const double a) const {
-    return Matrix4(*this) *= a;
+  constexpr Matrix4T operator * (const T a) const {
+    return Matrix4T(*this) *= a;
   }
 
-  Cvec4 operator * (const Cvec4& v) const {
-    Cvec4 r(0);
+  constexpr Cvec<T, 4> operator * (const Cvec<T, 4>& v) const {
+    Cvec<T, 4> r(0);
     for (int i = 0; i < 4; ++i) {
       for (int j = 0; j < 4; ++j) {
         r[i] += (*this)(i,j) * v(j);
@@ -112,8 +121,8 @@ public:
     return r;
   }
 
-  Matrix4 operator * (const Matrix4& m) const {
-    Matrix4 r(0);
+  constexpr Matrix4T operator * (const Matrix4T& m) const {
+    Matrix4T r(0);
     for (int i = 0; i < 4; ++i) {
       for (int j = 0; j < 4; ++j) {
         for (int k = 0; k < 4; ++k) {
@@ -125,63 +134,63 @@ public:
   }
 
 
-  static Matrix4 makeXRotation(const double ang) {
-    return makeXRotation(std::cos(ang * CS175_PI/180), std::sin(ang * CS175_PI/180));
+  static constexpr Matrix4T makeXRotation(const T ang) {
+    return makeXRotation(cxCos(ang * CS175_PI/180), cxSin(ang * CS175_PI/180));
   }
 
-  static Matrix4 makeYRotation(const double ang) {
-    return makeYRotation(std::cos(ang * CS175_PI/180), std::sin(ang * CS175_PI/180));
+  static constexpr Matrix4T makeYRotation(const T ang) {
+    return makeYRotation(cxCos(ang * CS175_PI/180), cxSin(ang * CS175_PI/180));
   }
 
-  static Matrix4 makeZRotation(const double ang) {
-    return makeZRotation(std::cos(ang * CS175_PI/180), std::sin(ang * CS175_PI/180));
+  static constexpr Matrix4T makeZRotation(const T ang) {
+    return makeZRotation(cxCos(ang * CS175_PI/180), cxSin(ang * CS175_PI/180));
   }
 
-  static Matrix4 makeXRotation(const double c, const double s) {
-    Matrix4 r;
+  static constexpr Matrix4T makeXRotation(const T c, const T s) {
+    Matrix4T r;
     r(1,1) = r(2,2) = c;
     r(1,2) = -s;
     r(2,1) = s;
     return r;
   }
 
-  static Matrix4 makeYRotation(const double c, const double s) {
-    Matrix4 r;
+  static constexpr Matrix4T makeYRotation(const T c, const T s) {
+    Matrix4T r;
     r(0,0) = r(2,2) = c;
     r(0,2) = s;
     r(2,0) = -s;
     return r;
   }
 
-  static Matrix4 makeZRotation(const double c, const double s) {
-    Matrix4 r;
+  static constexpr Matrix4T makeZRotation(const T c, const T s) {
+    Matrix4T r;
     r(0,0) = r(1,1) = c;
     r(0,1) = -s;
     r(1,0) = s;
     return r;
   }
 
-  static Matrix4 makeTranslation(const Cvec3& t) {
-    Matrix4 r;
+  static constexpr Matrix4T makeTranslation(const Cvec<T, 3>& t) {
+    Matrix4T r;
     for (int i = 0; i < 3; ++i) {
       r(i,3) = t[i];
     }
     return r;
   }
 
-  static Matrix4 makeScale(const Cvec3& s) {
-    Matrix4 r;
+  static constexpr Matrix4T makeScale(const Cvec<T, 3>& s) {
+    Matrix4T r;
     for (int i = 0; i < 3; ++i) {
       r(i,i) = s[i];
     }
     return r;
   }
 
-  static Matrix4 makeProjection(
-    const double top, const double bottom,
-    const double left, const double right,
-    const double nearClip, const double farClip) {
-    Matrix4 r(0);
+  static Matrix4T makeProjection(
+    const T top, const T bottom,
+    const T left, const T right,
+    const T nearClip, const T farClip) {
+    Matrix4T r(0);
     // 1st row
     if (std::abs(right - left) > CS175_EPS) {
       r(0,0) = -2.0 * nearClip / (right - left);
@@ -201,10 +210,10 @@ public:
     return r;
   }
 
-  static Matrix4 makeProjection(const double fovy, const double aspectRatio, const double zNear, const double zFar) {
-    Matrix4 r(0);
-    const double ang = fovy * 0.5 * CS175_PI/180;
-    const double f = std::abs(std::sin(ang)) < CS175_EPS ? 0 : 1/std::tan(ang);
+  static Matrix4T makeProjection(const T fovy, const T aspectRatio, const T zNear, const T zFar) {
+    Matrix4T r(0);
+    const T ang = fovy * 0.5 * CS175_PI/180;
+    const T f = std::abs(std::sin(ang)) < CS175_EPS ? 0 : 1/std::tan(ang);
     if (std::abs(aspectRatio) > CS175_EPS)
       r(0,0) = f/aspectRatio;  // 1st row
 
@@ -221,12 +230,19 @@ public:
 
 };
 
-inline bool isAffine(const Matrix4& m) {
-  return std::abs(m[15]-1) + std::abs(m[14]) + std::abs(m[13]) + std::abs(m[12]) < CS175_EPS;
+// double precision for editing and scene graph math, single precision for
+// the rendering and simulation paths
+typedef Matrix4T<double> Matrix4;
+typedef Matrix4T<float> Matrix4f;
+
+template <typename T>
+inline constexpr bool isAffine(const Matrix4T<T>& m) {
+  return cxAbs(m[15]-1) + cxAbs(m[14]) + cxAbs(m[13]) + cxAbs(m[12]) < CS175_EPS;
 }
 
-inline double norm2(const Matrix4& m) {
-  double r = 0;
+template <typename T>
+inline constexpr T norm2(const Matrix4T<T>& m) {
+  T r = 0;
   for (int i = 0; i < 16; ++i) {
     r += m[i]*m[i];
   }
@@ -234,15 +250,16 @@ inline double norm2(const Matrix4& m) {
 }
 
 // computes inverse of affine matrix. assumes last row is [0,0,0,1]
-inline Matrix4 inv(const Matrix4& m) {
-  Matrix4 r;                                              // default constructor initializes it to identity
+template <typename T>
+inline constexpr Matrix4T<T> inv(const Matrix4T<T>& m) {
+  Matrix4T<T> r;                                              // default constructor initializes it to identity
   assert(isAffine(m));
-  double det = m(0,0)*(m(1,1)*m(2,2) - m(1,2)*m(2,1)) +
-               m(0,1)*(m(1,2)*m(2,0) - m(1,0)*m(2,2)) +
-               m(0,2)*(m(1,0)*m(2,1) - m(1,1)*m(2,0));
+  T det = m(0,0)*(m(1,1)*m(2,2) - m(1,2)*m(2,1)) +
+          m(0,1)*(m(1,2)*m(2,0) - m(1,0)*m(2,2)) +
+          m(0,2)*(m(1,0)*m(2,1) - m(1,1)*m(2,0));
 
   // check non-singular matrix
-  assert(std::abs(det) > CS175_EPS3);
+  assert(cxAbs(det) > CS175_EPS3);
 
   // "rotation part"
   r(0,0) =  (m(1,1) * m(2,2) - m(1,2) * m(2,1)) / det;
@@ -259,12 +276,13 @@ inline Matrix4 inv(const Matrix4& m) {
   r(0,3) = -(m(0,3) * r(0,0) + m(1,3) * r(0,1) + m(2,3) * r(0,2));
   r(1,3) = -(m(0,3) * r(1,0) + m(1,3) * r(1,1) + m(2,3) * r(1,2));
   r(2,3) = -(m(0,3) * r(2,0) + m(1,3) * r(2,1) + m(2,3) * r(2,2));
-  assert(isAffine(r) && norm2(Matrix4() - m*r) < CS175_EPS2);
+  assert(isAffine(r) && norm2(Matrix4T<T>() - m*r) < CheckTolerance<T>::eps2());
   return r;
 }
 
-inline Matrix4 transpose(const Matrix4& m) {
-  Matrix4 r(0);
+template <typename T>
+inline constexpr Matrix4T<T> transpose(const Matrix4T<T>& m) {
+  Matrix4T<T> r(0);
   for (int i = 0; i < 4; ++i) {
     for (int j = 0; j < 4; ++j) {
       r(i,j) = m(j,i);
@@ -273,13 +291,236 @@ inline Matrix4 transpose(const Matrix4& m) {
   return r;
 }
 
-inline Matrix4 normalMatrix(const Matrix4& m) {
-  Matrix4 invm = inv(m);
+template <typename T>
+inline constexpr Matrix4T<T> normalMatrix(const Matrix4T<T>& m) {
+  Matrix4T<T> invm = inv(m);
   invm(0, 3) = invm(1, 3) = invm(2, 3) = 0;
   return transpose(invm);
 }
 
-inline Matrix4 transFact(const Matrix4& m) {
+// An affine transform stored as the upper 3x4 block of a Matrix4T whose
+// last row is [0,0,0,1]. Products, inverses and normal matrices only touch
+// the 12 stored entries instead of going through the general 4x4 routines.
+// Use toMatrix4() where a full Matrix4T is needed (e.g. to send it to a shader)
+template <typename T>
+class AffineMatrixT {
+  T d_[12]; // layout is row-major, rows 0 to 2 of the 4x4 matrix
+
+public:
+  constexpr T &operator () (const int row, const int col) {
+    return d_[(row << 2) + col];
+  }
+
+  constexpr const T &operator () (const int row, const int col) const {
+    return d_[(row << 2) + col];
+  }
+
+  constexpr AffineMatrixT() : d_() {
+    for (int i = 0; i < 12; ++i) {
+      d_[i] = 0;
+    }
+    for (int i = 0; i < 3; ++i) {
+      (*this)(i,i) = 1;
+    }
+  }
+
+  explicit constexpr AffineMatrixT(const Matrix4T<T>& m) : d_() {
+    assert(isAffine(m));
+    for (int i = 0; i < 12; ++i) {
+      d_[i] = m[i];
+    }
+  }
+
+  // conversion between precisions
+  template <typename S>
+  explicit constexpr AffineMatrixT(const AffineMatrixT<S>& m) : d_() {
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 4; ++j) {
+        (*this)(i,j) = T(m(i,j));
+      }
+    }
+  }
+
+  constexpr Matrix4T<T> toMatrix4() const {
+    Matrix4T<T> r;
+    for (int i = 0; i < 12; ++i) {
+      r[i] = d_[i];
+    }
+    return r;
+  }
+
+  constexpr Cvec<T, 3> getTranslation() const {
+    return Cvec<T, 3>(d_[3], d_[7], d_[11]);
+  }
+
+  constexpr AffineMatrixT& setTranslation(const Cvec<T, 3>& t) {
+    d_[3] = t[0];
+    d_[7] = t[1];
+    d_[11] = t[2];
+    return *this;
+  }
+
+  constexpr Cvec<T, 4> operator * (const Cvec<T, 4>& v) const {
+    const T* a = d_;
+    return Cvec<T, 4>(a[0]*v[0] + a[1]*v[1] + a[2]*v[2] + a[3]*v[3],
+                      a[4]*v[0] + a[5]*v[1] + a[6]*v[2] + a[7]*v[3],
+                      a[8]*v[0] + a[9]*v[1] + a[10]*v[2] + a[11]*v[3],
+                      v[3]);
+  }
+
+  // the implicit last rows [0,0,0,1] are never multiplied
+  constexpr AffineMatrixT operator * (const AffineMatrixT& m) const {
+    AffineMatrixT r;
+    const T* a = d_;
+    const T* b = m.d_;
+    for (int i = 0; i < 3; ++i, a += 4) {
+      T* c = r.d_ + 4*i;
+      c[0] = a[0]*b[0] + a[1]*b[4] + a[2]*b[8];
+      c[1] = a[0]*b[1] + a[1]*b[5] + a[2]*b[9];
+      c[2] = a[0]*b[2] + a[1]*b[6] + a[2]*b[10];
+      c[3] = a[0]*b[3] + a[1]*b[7] + a[2]*b[11] + a[3];
+    }
+    return r;
+  }
+
+  constexpr AffineMatrixT& operator *= (const AffineMatrixT& m) {
+    return *this = *this * m;
+  }
+
+  static constexpr AffineMatrixT makeTranslation(const Cvec<T, 3>& t) {
+    return AffineMatrixT().setTranslation(t);
+  }
+
+  static constexpr AffineMatrixT makeScale(const Cvec<T, 3>& s) {
+    AffineMatrixT r;
+    for (int i = 0; i < 3; ++i) {
+      r(i,i) = s[i];
+    }
+    return r;
+  }
+};
+
+typedef AffineMatrixT<double> AffineMatrix;
+typedef AffineMatrixT<float> AffineMatrixf;
+
+// cofactor matrix of the linear part, i.e. det * transpose(inverse)
+// the translation of the result is zero
+template <typename T>
+inline constexpr AffineMatrixT<T> linearCofactor(const AffineMatrixT<T>& m) {
+  AffineMatrixT<T> c;
+  c(0,0) = m(1,1) * m(2,2) - m(1,2) * m(2,1);
+  c(0,1) = m(1,2) * m(2,0) - m(1,0) * m(2,2);
+  c(0,2) = m(1,0) * m(2,1) - m(1,1) * m(2,0);
+  c(1,0) = m(0,2) * m(2,1) - m(0,1) * m(2,2);
+  c(1,1) = m(0,0) * m(2,2) - m(0,2) * m(2,0);
+  c(1,2) = m(0,1) * m(2,0) - m(0,0) * m(2,1);
+  c(2,0) = m(0,1) * m(1,2) - m(0,2) * m(1,1);
+  c(2,1) = m(0,2) * m(1,0) - m(0,0) * m(1,2);
+  c(2,2) = m(0,0) * m(1,1) - m(0,1) * m(1,0);
+  return c;
+}
+
+// translation part of the inverse, given the inverse linear part in r
+template <typename T>
+inline constexpr AffineMatrixT<T>& setInverseTranslation(AffineMatrixT<T>& r, const AffineMatrixT<T>& m) {
+  for (int i = 0; i < 3; ++i) {
+    r(i,3) = -(r(i,0) * m(0,3) + r(i,1) * m(1,3) + r(i,2) * m(2,3));
+  }
+  return r;
+}
+
+// computes inverse of any non-singular affine matrix
+template <typename T>
+inline constexpr AffineMatrixT<T> inv(const AffineMatrixT<T>& m) {
+  const AffineMatrixT<T> c = linearCofactor(m);
+  const T det = m(0,0) * c(0,0) + m(0,1) * c(0,1) + m(0,2) * c(0,2);
+  assert(cxAbs(det) > CS175_EPS3);
+
+  AffineMatrixT<T> r;
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      r(i,j) = c(j,i) / det;
+    }
+  }
+  return setInverseTranslation(r, m);
+}
+
+// computes inverse of a rigid body transform followed by a (possibly non-uniform) scale,
+// i.e. T * R * S. The columns of the linear part are then orthogonal, and
+// row i of the inverse is column i divided by its squared length.
+template <typename T>
+inline constexpr AffineMatrixT<T> invRigidScale(const AffineMatrixT<T>& m) {
+  AffineMatrixT<T> r;
+  for (int j = 0; j < 3; ++j) {
+    const T len2 = m(0,j)*m(0,j) + m(1,j)*m(1,j) + m(2,j)*m(2,j);
+    assert(len2 > CS175_EPS3);
+    for (int i = 0; i < 3; ++i) {
+      r(j,i) = m(i,j) / len2;
+    }
+  }
+  setInverseTranslation(r, m);
+  assert(norm2((m * r).toMatrix4() - Matrix4T<T>()) < CheckTolerance<T>::eps2());
+  return r;
+}
+
+// transpose of the inverse linear part, from the cofactors without forming the inverse
+template <typename T>
+inline constexpr AffineMatrixT<T> normalMatrix(const AffineMatrixT<T>& m) {
+  AffineMatrixT<T> c = linearCofactor(m);
+  const T det = m(0,0) * c(0,0) + m(0,1) * c(0,1) + m(0,2) * c(0,2);
+  assert(cxAbs(det) > CS175_EPS3);
+
+  const T invDet = 1 / det;
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      c(i,j) *= invDet;
+    }
+  }
+  return c;
+}
+
+// out[i] = m * (in[i], w) for count 3-vectors, with w = 1 for points and 0 for vectors.
+// in and out may be the same array
+template <typename T>
+inline constexpr void transformCvec3s(const AffineMatrixT<T>& m, const T w, const Cvec<T, 3>* in, Cvec<T, 3>* out, int count) {
+  for (int i = 0; i < count; ++i) {
+    const T x = in[i][0], y = in[i][1], z = in[i][2];
+    for (int j = 0; j < 3; ++j) {
+      out[i][j] = m(j,0) * x + m(j,1) * y + m(j,2) * z + m(j,3) * w;
+    }
+  }
+}
+
+#if defined(CS175_SIMD_SSE2)
+// double version computing the x and y rows together
+inline void transformCvec3s(const AffineMatrix& m, const double w, const Cvec3* in, Cvec3* out, int count) {
+  const __m128d c0 = _mm_set_pd(m(1,0), m(0,0));
+  const __m128d c1 = _mm_set_pd(m(1,1), m(0,1));
+  const __m128d c2 = _mm_set_pd(m(1,2), m(0,2));
+  const __m128d c3 = _mm_set_pd(m(1,3) * w, m(0,3) * w);
+  const double r0 = m(2,0), r1 = m(2,1), r2 = m(2,2), r3 = m(2,3) * w;
+  for (int i = 0; i < count; ++i) {
+    const double x = in[i][0], y = in[i][1], z = in[i][2];
+    __m128d r = _mm_add_pd(_mm_mul_pd(c0, _mm_set1_pd(x)), _mm_mul_pd(c1, _mm_set1_pd(y)));
+    r = _mm_add_pd(r, _mm_add_pd(_mm_mul_pd(c2, _mm_set1_pd(z)), c3));
+    _mm_storeu_pd(&out[i][0], r);
+    out[i][2] = r0 * x + r1 * y + r2 * z + r3;
+  }
+}
+#endif
+
+template <typename T>
+inline constexpr void transformPoints(const AffineMatrixT<T>& m, const Cvec<T, 3>* in, Cvec<T, 3>* out, int count) {
+  transformCvec3s(m, T(1), in, out, count);
+}
+
+template <typename T>
+inline constexpr void transformVectors(const AffineMatrixT<T>& m, const Cvec<T, 3>* in, Cvec<T, 3>* out, int count) {
+  transformCvec3s(m, T(0), in, out, count);
+}
+
+template <typename T>
+inline constexpr Matrix4T<T> transFact(const Matrix4T<T>& m) {
    /* Translation
     * |  0  1  2   3
     * 0  1  0  0  t_x
@@ -288,10 +529,10 @@ inline Matrix4 transFact(const Matrix4& m) {
     * 3  0  0  0   1
     */
 
-    Matrix4 factored_m = Matrix4();     // 4x4 matrix of zeros
-    double t_x = m(0, 3);
-    double t_y = m(1, 3);
-    double t_z = m(2, 3);
+    Matrix4T<T> factored_m = Matrix4T<T>();     // 4x4 matrix of zeros
+    T t_x = m(0, 3);
+    T t_y = m(1, 3);
+    T t_z = m(2, 3);
 
     // fill the upper left 3x3 submatrix as identity
     factored_m(0, 0) = 1;
@@ -307,7 +548,8 @@ inline Matrix4 transFact(const Matrix4& m) {
     return factored_m;
 }
 
-inline Matrix4 linFact(const Matrix4& m) {
+template <typename T>
+inline constexpr Matrix4T<T> linFact(const Matrix4T<T>& m) {
     /* Linear (Rotation + Scaling)
      * |  0  1  2   3
      * 0  a  b  c   0
@@ -316,7 +558,7 @@ inline Matrix4 linFact(const Matrix4& m) {
      * 3  0  0  0   1
      */
 
-    Matrix4 factored_m = Matrix4();     // 4x4 matrix of zeros
+    Matrix4T<T> factored_m = Matrix4T<T>();     // 4x4 matrix of zeros
 
     // fill upper left with linear elements
     for (int i = 0; i < 3; ++i) {
@@ -333,17 +575,20 @@ inline Matrix4 linFact(const Matrix4& m) {
 
 // Get transform matrix which perform transform 'M' on object matrix 'O'
 // with respect to auxiliary frame 'A'
-inline Matrix4 doMtoOwrtA(const Matrix4& M, const Matrix4& O, const Matrix4& A) {
+template <typename T>
+inline constexpr Matrix4T<T> doMtoOwrtA(const Matrix4T<T>& M, const Matrix4T<T>& O, const Matrix4T<T>& A) {
     return A * M * inv(A) * O;
 }
 
 // Create mixed frame centered at object position 'O',
 // and whose axes are aligned with eye frame 'E'
-inline Matrix4 makeMixedFrame(const Matrix4& O, const Matrix4& E) {
+template <typename T>
+inline constexpr Matrix4T<T> makeMixedFrame(const Matrix4T<T>& O, const Matrix4T<T>& E) {
     return transFact(O) * linFact(E);
 }
 
-inline void printMatrix4(const Matrix4& A) {
+template <typename T>
+inline void printMatrix4(const Matrix4T<T>& A) {
     for (int i = 0; i < 4; ++i) {
         for (int j = 0; j < 4; ++j) {
             std::cout << A(i, j) << " ";
@@ -8,78 +8,142 @@
 #include "cvec.h"
 #include "matrix4.h"
 
-// Forward declarations used in the definition of Quat;
-class Quat;
-double dot(const Quat& q, const Quat& p);
-double norm2(const Quat& q);
-Quat inv(const Quat& q);
-Quat pow(const Quat& q, const double& alpha);
-Quat normalize(const Quat& q);
-Matrix4 quatToMatrix(const Quat& q);
-
-class Quat {
-  Cvec4 q_;  // layout is: q_[0]==w, q_[1]==x, q_[2]==y, q_[3]==z
+// Quaternion product r = a * b on (w, x, y, z) arrays. The scalar version
+// is also used in constant expressions, the QuatKernel<double>
+// specialization below uses SSE2 when available.
+template <typename T>
+struct QuatScalarKernel {
+  static constexpr void mul(const T* a, const T* b, T* r) {
+    const Cvec<T, 3> u(a[1], a[2], a[3]), v(b[1], b[2], b[3]);
+    const Cvec<T, 3> c = (v*a[0] + u*b[0]) + cross(u, v);
+    r[0] = a[0]*b[0] - dot(u, v);
+    r[1] = c[0], r[2] = c[1], r[3] = c[2];
+  }
+};
+
+template <typename T>
+struct QuatKernel : QuatScalarKernel<T> {};
+
+#if defined(CS175_SIMD_SSE2)
+template <>
+struct QuatKernel<double> {
+  static void mul(const double* a, const double* b, double* r) {
+    // r = w * b + x * (-bx, bw, -bz, by) + y * (-by, bz, bw, -bx) + z * (-bz, -by, bx, bw)
+    // with (w, x) and (y, z) of b in separate registers
+    const __m128d lo = _mm_loadu_pd(&b[0]);                       // (bw, bx)
+    const __m128d hi = _mm_loadu_pd(&b[2]);                       // (by, bz)
+    const __m128d swlo = _mm_shuffle_pd(lo, lo, 1);               // (bx, bw)
+    const __m128d swhi = _mm_shuffle_pd(hi, hi, 1);               // (bz, by)
+    const __m128d negFirst = _mm_set_pd(0.0, -0.0);
+    const __m128d negSecond = _mm_set_pd(-0.0, 0.0);
+    const __m128d w = _mm_set1_pd(a[0]), x = _mm_set1_pd(a[1]), y = _mm_set1_pd(a[2]), z = _mm_set1_pd(a[3]);
+    __m128d rlo = _mm_mul_pd(w, lo);
+    __m128d rhi = _mm_mul_pd(w, hi);
+    rlo = _mm_add_pd(rlo, _mm_mul_pd(x, _mm_xor_pd(swlo, negFirst)));
+    rhi = _mm_add_pd(rhi, _mm_mul_pd(x, _mm_xor_pd(swhi, negFirst)));
+    rlo = _mm_add_pd(rlo, _mm_mul_pd(y, _mm_xor_pd(hi, negFirst)));
+    rhi = _mm_add_pd(rhi, _mm_mul_pd(y, _mm_xor_pd(lo, negSecond)));
+    rlo = _mm_sub_pd(rlo, _mm_mul_pd(z, swhi));
+    rhi = _mm_add_pd(rhi, _mm_mul_pd(z, swlo));
+    _mm_storeu_pd(&r[0], rlo);
+    _mm_storeu_pd(&r[2], rhi);
+  }
+};
+#endif
+
+// Quaternion with elements of type T (see the typedefs below)
+template <typename T>
+class QuatT {
+  Cvec<T, 4> q_;  // layout is: q_[0]==w, q_[1]==x, q_[2]==y, q_[3]==z
 
 public:
-  double operator [] (const int i) const {
+  constexpr T operator [] (const int i) const {
     return q_[i];
   }
 
-  double& operator [] (const int i) {
+  constexpr T& operator [] (const int i) {
     return q_[i];
   }
 
-  double operator () (const int i) const {
+  constexpr T operator () (const int i) const {
     return q_[i];
   }
 
-  double& operator () (const int i) {
+  constexpr T& operator () (const int i) {
     return q_[i];
   }
 
-  Quat() : q_(1,0,0,0) {}
-  Quat(const double w, const Cvec3& v) : q_(w, v[0], v[1], v[2]) {}
-  Quat(const double w, const double x, const double y, const double z) : q_(w, x,y,z) {}
+  constexpr QuatT() : q_(1,0,0,0) {}
+  constexpr QuatT(const T w, const Cvec<T, 3>& v) : q_(w, v[0], v[1], v[2]) {}
+  constexpr QuatT(const T w, const T x, const T y, const T z) : q_(w, x,y,z) {}
 
-  Quat& operator += (const Quat& a) {
+  // conversion between precisions
+  template <typename S>
+  explicit constexpr QuatT(const QuatT<S>& q) : q_(T(q[0]), T(q[1]), T(q[2]), T(q[3])) {}
+
+  constexpr QuatT& operator += (const QuatT& a) {
     q_ += a.q_;
     return *this;
   }
 
-  Quat& operator -= (const Quat& a) {
+  constexpr QuatT& operator -= (const QuatT& a) {
     q_ -= a.q_;
     return *this;
   }
 
-  Quat& operator *= (const double a) {
+  constexpr QuatT& operator *= (const T a) {
     q_ *= a;
     return *this;
   }
 
-  Quat& operator /= (const double a) {
+  constexpr QuatT& operator /= (const T a) {
     q_ /= a;
     return *this;
   }
 
-  Quat operator + (const Quat& a) const {
-    return Quat(*this) += a;
+  constexpr QuatT operator + (const QuatT& a) const {
+    return QuatT(*this) += a;
   }
 
-  Quat operator - (const Quat& a) const {
-    return Quat(*this) -= a;
+  constexpr QuatT operator - (const QuatT& a) const {
+    return QuatT(*this) -= a;
   }
 
-  Quat operator * (const double a) const {
-    return Quat(*this) *= a;
+  constexpr QuatT operator * (const T a) const {
+    return QuatT(*this) *= a;
   }
 
-  Quat operator / (const double a) const {
-    return Quat(*this) /= a;
+  constexpr QuatT operator / (const T a) const {
+    return QuatT(*this) /= a;
   }
 
-  Quat operator * (const Quat& a) const {
-    const Cvec3 u(q_[1], q_[2], q_[3]), v(a.q_[1], a.q_[2], a.q_[3]);
-    return Quat(q_[0]*a.q_[0] - dot(u, v), (v*q_[0] + u*a.q_[0]) + cross(u, v));
+  constexpr QuatT operator * (const QuatT& a) const {
+    QuatT r;
+    if (isConstantEvaluated())
+      QuatScalarKernel<T>::mul(&q_[0], &a.q_[0], &r.q_[0]);
+    else
+      QuatKernel<T>::mul(&q_[0], &a.q_[0], &r.q_[0]);
+    return r;
+  }
+
+  /*
+  * Rotate a 3-vector, i.e. the vector part of q * (0, v) * inv(q)
+  *
+  * With q = (w, u) and t = 2 (u x v) / |q|^2, this expands to
+  * v + w t + u x t, which needs two cross products instead of two
+  * quaternion products. q does not need to be a unit quaternion.
+  */
+  constexpr Cvec<T, 3> rotate(const Cvec<T, 3>& v) const {
+    const T n = q_[0]*q_[0] + q_[1]*q_[1] + q_[2]*q_[2] + q_[3]*q_[3];
+    assert(n > CS175_EPS2);
+    const T s = 2 / n;
+    const T w = q_[0], x = q_[1], y = q_[2], z = q_[3];
+    const T tx = (y*v[2] - z*v[1]) * s;
+    const T ty = (z*v[0] - x*v[2]) * s;
+    const T tz = (x*v[1] - y*v[0]) * s;
+    return Cvec<T, 3>(v[0] + w*tx + (y*tz - z*ty),
+                      v[1] + w*ty + (z*tx - x*tz),
+                      v[2] + w*tz + (x*ty - y*tx));
   }
 
   /*
@@ -88,86 +152,94 @@ public:
   * Input: Cvec4 object (either coordinate or vector)
   * Output: Cvec4 object (rotated by quaternion)
   */
-  Cvec4 operator * (const Cvec4& a) const {
-    const Quat r = *this * (Quat(0, a[0], a[1], a[2]) * inv(*this));
-    return Cvec4(r[1], r[2], r[3], a[3]);
+  constexpr Cvec<T, 4> operator * (const Cvec<T, 4>& a) const {
+    return Cvec<T, 4>(rotate(Cvec<T, 3>(a[0], a[1], a[2])), a[3]);
   }
 
-  static Quat makeXRotation(const double ang) {
-    Quat r;
-    const double h = 0.5 * ang * CS175_PI/180;
-    r.q_[1] = std::sin(h);
-    r.q_[0] = std::cos(h);
+  static constexpr QuatT makeXRotation(const T ang) {
+    QuatT r;
+    const T h = 0.5 * ang * CS175_PI/180;
+    r.q_[1] = cxSin(h);
+    r.q_[0] = cxCos(h);
     return r;
   }
 
-  static Quat makeYRotation(const double ang) {
-    Quat r;
-    const double h = 0.5 * ang * CS175_PI/180;
-    r.q_[2] = std::sin(h);
-    r.q_[0] = std::cos(h);
+  static constexpr QuatT makeYRotation(const T ang) {
+    QuatT r;
+    const T h = 0.5 * ang * CS175_PI/180;
+    r.q_[2] = cxSin(h);
+    r.q_[0] = cxCos(h);
     return r;
   }
 
-  static Quat makeZRotation(const double ang) {
-    Quat r;
-    const double h = 0.5 * ang * CS175_PI/180;
-    r.q_[3] = std::sin(h);
-    r.q_[0] = std::cos(h);
+  static constexpr QuatT makeZRotation(const T ang) {
+    QuatT r;
+    const T h = 0.5 * ang * CS175_PI/180;
+    r.q_[3] = cxSin(h);
+    r.q_[0] = cxCos(h);
     return r;
   }
 };
 
-inline double dot(const Quat& q, const Quat& p) {
-  double s = 0.0;
+typedef QuatT<double> Quat;
+typedef QuatT<float> Quatf;
+
+template <typename T>
+inline constexpr T dot(const QuatT<T>& q, const QuatT<T>& p) {
+  T s = 0.0;
   for (int i = 0; i < 4; ++i) {
     s += q(i) * p(i);
   }
   return s;
 }
 
-inline double norm2(const Quat& q) {
+template <typename T>
+inline constexpr T norm2(const QuatT<T>& q) {
   return dot(q, q);
 }
 
-inline Quat inv(const Quat& q) {
-  const double n = norm2(q);
+template <typename T>
+inline constexpr QuatT<T> inv(const QuatT<T>& q) {
+  const T n = norm2(q);
   assert(n > CS175_EPS2);
-  return Quat(q(0), -q(1), -q(2), -q(3)) * (1.0/n);
+  return QuatT<T>(q(0), -q(1), -q(2), -q(3)) * (1.0/n);
 }
 
-inline Quat normalize(const Quat& q) {
-  return q / std::sqrt(norm2(q));
+template <typename T>
+inline constexpr QuatT<T> normalize(const QuatT<T>& q) {
+  return q / cxSqrt(norm2(q));
 }
 
 /*
 * Power operator for quaternions
 */
-inline Quat pow(const Quat& q, const double& alpha) {
+template <typename T>
+inline QuatT<T> pow(const QuatT<T>& q, const double& alpha) {
     /*
     * Assume input quaternion q is of form
     * [ cos(theta), sin(theta) *k ]
     */
 
-    Cvec3 k = Cvec3(q(1), q(2), q(3));
-    double cosine = q(0);
-    double sine = norm(k);
-    double theta = atan2(sine, cosine);
+    Cvec<T, 3> k = Cvec<T, 3>(q(1), q(2), q(3));
+    T cosine = q(0);
+    T sine = norm(k);
+    T theta = atan2(sine, cosine);
 
     if (sine < CS175_EPS) {
-        return Quat(cos(alpha * theta), 0, 0, 0);
+        return QuatT<T>(cos(alpha * theta), 0, 0, 0);
     }
 
-    return Quat(cos(alpha * theta), normalize(k) * sin(alpha * theta));
+    return QuatT<T>(cos(alpha * theta), normalize(k) * sin(alpha * theta));
 }
 
-inline Matrix4 quatToMatrix(const Quat& q) {
-  Matrix4 r;
-  const double n = norm2(q);
+template <typename T>
+inline constexpr Matrix4T<T> quatToMatrix(const QuatT<T>& q) {
+  Matrix4T<T> r;
+  const T n = norm2(q);
   if (n < CS175_EPS2)
-    return Matrix4(0);
+    return Matrix4T<T>(0);
 
-  const double two_over_n = 2/n;
+  const T two_over_n = 2/n;
   r(0, 0) -= (q(2)*q(2) + q(3)*q(3)) * two_over_n;
   r(0, 1) += (q(1)*q(2) - q(0)*q(3)) * two_over_n;
   r(0, 2) += (q(1)*q(3) + q(2)*q(0)) * two_over_n;
@@ -7,47 +7,54 @@
 #include "matrix4.h"
 #include "quat.h"
 
-class RigTForm {
-  Cvec3 t_; // translation component
-  Quat r_;  // rotation component represented as a quaternion
+// Rigid body transform with elements of type T (see the typedefs below)
+template <typename T>
+class RigTFormT {
+  Cvec<T, 3> t_; // translation component
+  QuatT<T> r_;  // rotation component represented as a quaternion
 
 public:
-  RigTForm() : t_(Cvec3(0,0,0)) {
+  constexpr RigTFormT() : t_(Cvec<T, 3>(0,0,0)) {
         // Note that a unit norm quaternion of form (1, 0, 0, 0) represents identity rotation in 3D
-        assert(norm2(Quat(1,0,0,0) - r_) < CS175_EPS2);
+        assert(norm2(QuatT<T>(1,0,0,0) - r_) < CS175_EPS2);
   }
 
   // Constructor
-  RigTForm(const Cvec3& t, const Quat& r) {
+  constexpr RigTFormT(const Cvec<T, 3>& t, const QuatT<T>& r) {
       t_ = t;
       r_ = r;
   }
 
-  explicit RigTForm(const Cvec3& t) {
+  explicit constexpr RigTFormT(const Cvec<T, 3>& t) {
       t_ = t;
       // Note that a unit norm quaternion of form (1, 0, 0, 0) represents identity rotation in 3D
-      assert(norm2(Quat(1, 0, 0, 0) - r_) < CS175_EPS2);
+      assert(norm2(QuatT<T>(1, 0, 0, 0) - r_) < CS175_EPS2);
   }
 
-  explicit RigTForm(const Quat& r) {
-      t_ = Cvec3();    // zero vector in 3D
+  // conversion between precisions
+  template <typename S>
+  explicit constexpr RigTFormT(const RigTFormT<S>& a)
+    : t_(a.getTranslation()), r_(a.getRotation()) {}
+
+  explicit constexpr RigTFormT(const QuatT<T>& r) {
+      t_ = Cvec<T, 3>();    // zero vector in 3D
       r_ = r;
   }
 
-  Cvec3 getTranslation() const {
+  constexpr Cvec<T, 3> getTranslation() const {
     return t_;
   }
 
-  Quat getRotation() const {
+  constexpr QuatT<T> getRotation() const {
     return r_;
   }
 
-  RigTForm& setTranslation(const Cvec3& t) {
+  constexpr RigTFormT& setTranslation(const Cvec<T, 3>& t) {
     t_ = t;
     return *this;
   }
 
-  RigTForm& setRotation(const Quat& r) {
+  constexpr RigTFormT& setRotation(const QuatT<T>& r) {
     r_ = r;
     return *this;
   }
@@ -64,123 +71,102 @@ public:
   * Exception:
   * - Throws exception when Cvec4 doesn't represent neither coordinate nor vector in Affine frame
   */
-  Cvec4 operator * (const Cvec4& a) const {
+  constexpr Cvec<T, 4> operator * (const Cvec<T, 4>& a) const {
       assert(a[3] == 0 || a[3] == 1);
 
       // if 'a' is a coordinate, translate it
       // otherwise, do nothing
-      Cvec4 t_a = (*this).getRotation() * a;
-
-      if (a[3] == 1) {
-          // 'a' represents a coordinate in Affine form
-          Cvec3 t_ = (*this).getTranslation();
-          Cvec4 t = Cvec4(t_[0], t_[1], t_[2], 0);
-          t_a += t;
-      }
+      Cvec<T, 3> t_a = r_.rotate(Cvec<T, 3>(a[0], a[1], a[2]));
+      if (a[3] == 1)
+          t_a += t_;
 
-      return t_a;
+      return Cvec<T, 4>(t_a, a[3]);
   }
 
   // Calculate RigTForm object representing the compound RBT of two RBTs
-  RigTForm operator * (const RigTForm& a) const {
-      // get t_1 and t_2 
-      Cvec3 t_1_ = (*this).getTranslation();
-      Cvec4 t_1 = Cvec4(t_1_, 0);
-      Cvec3 t_2_ = a.getTranslation();
-      Cvec4 t_2 = Cvec4(t_2_, 0);
-
-      // get r_1 and r_2
-      Quat r_1 = (*this).getRotation();
-      Quat r_2 = a.getRotation();
-
-      // calculate translation part
-      Cvec4 trans = t_1 + r_1 * t_2;
-      assert(trans[3] == 0);
-
-      Cvec3 t_ = Cvec3(trans);
-
-      // calculate rotation part
-      Quat r_ = r_1 * r_2;    
-
-      return RigTForm(t_, r_);
+  // (t_1, r_1) * (t_2, r_2) = (t_1 + r_1 t_2, r_1 r_2)
+  constexpr RigTFormT operator * (const RigTFormT& a) const {
+      return RigTFormT(t_ + r_.rotate(a.t_), r_ * a.r_);
   }
 
-  static RigTForm makeXRotation(const double& ang) {
-      return RigTForm(Quat::makeXRotation(ang));
+  static constexpr RigTFormT makeXRotation(const T& ang) {
+      return RigTFormT(QuatT<T>::makeXRotation(ang));
   }
 
-  static RigTForm makeYRotation(const double& ang) {
-      return RigTForm(Quat::makeYRotation(ang));
+  static constexpr RigTFormT makeYRotation(const T& ang) {
+      return RigTFormT(QuatT<T>::makeYRotation(ang));
   }
 
-  static RigTForm makeZRotation(const double& ang) {
-      return RigTForm(Quat::makeZRotation(ang));
+  static constexpr RigTFormT makeZRotation(const T& ang) {
+      return RigTFormT(QuatT<T>::makeZRotation(ang));
   }
 
-  static RigTForm makeTranslation(const Cvec3& t) {
-      return RigTForm(t);
+  static constexpr RigTFormT makeTranslation(const Cvec<T, 3>& t) {
+      return RigTFormT(t);
   }
 };
 
+typedef RigTFormT<double> RigTForm;
+typedef RigTFormT<float> RigTFormf;
+
 // Calculate the inverse of the given RBT in RigTForm form
-inline RigTForm inv(const RigTForm& tform) {
-    // get t_1
-    Cvec3 t__ = tform.getTranslation();
-    Cvec4 t = Cvec4(t__, 0);
+template <typename T>
+inline constexpr RigTFormT<T> inv(const RigTFormT<T>& tform) {
+    // (t, r)^-1 = (-(r^-1 t), r^-1)
+    const QuatT<T> r_inv = inv(tform.getRotation());
+    return RigTFormT<T>(-r_inv.rotate(tform.getTranslation()), r_inv);
+}
 
-    // calculate rotation part
-    Quat r_inv = inv(tform.getRotation());
+template <typename T>
+inline constexpr RigTFormT<T> transFact(const RigTFormT<T>& tform) {
+  return RigTFormT<T>(tform.getTranslation());
+}
 
-    // calculate transform part
-    Cvec4 trans = -(r_inv * t);
-    Cvec3 t_ = Cvec3(trans);
+template <typename T>
+inline constexpr RigTFormT<T> linFact(const RigTFormT<T>& tform) {
+  return RigTFormT<T>(tform.getRotation());
+}
 
-    return RigTForm(t_, r_inv);
+template <typename T>
+inline constexpr RigTFormT<T> makeMixedFrame(const RigTFormT<T>& O, const RigTFormT<T>& E) {
+    return transFact(O) * linFact(E);
 }
 
-inline RigTForm transFact(const RigTForm& tform) {
-  return RigTForm(tform.getTranslation());
+template <typename T>
+inline constexpr AffineMatrixT<T> rigTFormToAffineMatrix(const RigTFormT<T>& tform) {
+    // TR: rotation in the linear part, translation in the last column
+    AffineMatrixT<T> RBT_mat(quatToMatrix(tform.getRotation()));
+    return RBT_mat.setTranslation(tform.getTranslation());
 }
 
-inline RigTForm linFact(const RigTForm& tform) {
-  return RigTForm(tform.getRotation());
+template <typename T>
+inline constexpr Matrix4T<T> rigTFormToMatrix(const RigTFormT<T>& tform) {
+    return rigTFormToAffineMatrix(tform).toMatrix4();
 }
 
-inline RigTForm makeMixedFrame(const RigTForm& O, const RigTForm& E) {
-    return transFact(O) * linFact(E);
+// Apply tform to count points (translation included), in and out may be the same array
+template <typename T>
+inline void transformPoints(const RigTFormT<T>& tform, const Cvec<T, 3>* in, Cvec<T, 3>* out, int count) {
+    transformPoints(rigTFormToAffineMatrix(tform), in, out, count);
 }
 
-inline Matrix4 rigTFormToMatrix(const RigTForm& tform) {
-    // get translation, rotation factors
-    Cvec3 t_ = tform.getTranslation();    // T (vector)
-    Matrix4 r_mat = quatToMatrix(tform.getRotation());    // R
-
-    Matrix4 t_mat = Matrix4();
-
-    // fill diagonal elements with 1
-    t_mat(0, 0) = 1;
-    t_mat(1, 1) = 1;
-    t_mat(2, 2) = 1;
-    t_mat(3, 3) = 1;
-
-    t_mat(0, 3) = t_[0];    // t_x
-    t_mat(1, 3) = t_[1];    // t_y
-    t_mat(2, 3) = t_[2];    // t_z
-    
-    Matrix4 RBT_mat = t_mat * r_mat;    // TR
-    assert(isAffine(RBT_mat));
-    return RBT_mat;
+// Apply the rotation of tform to count vectors, in and out may be the same array
+template <typename T>
+inline void transformVectors(const RigTFormT<T>& tform, const Cvec<T, 3>* in, Cvec<T, 3>* out, int count) {
+    transformVectors(rigTFormToAffineMatrix(tform), in, out, count);
 }
 
-inline RigTForm doMtoOwrtA(RigTForm M, RigTForm O, RigTForm A) {
+template <typename T>
+inline constexpr RigTFormT<T> doMtoOwrtA(RigTFormT<T> M, RigTFormT<T> O, RigTFormT<T> A) {
     return A * M * inv(A) * O;
 }
 
 // Utility for debugging
-inline void printRigTForm(const RigTForm& A) {
-    Cvec3 t_ = A.getTranslation();
+template <typename T>
+inline void printRigTForm(const RigTFormT<T>& A) {
+    Cvec<T, 3> t_ = A.getTranslation();
     std::cout << "Translation: " << t_[0] << " " << t_[1] << " " << t_[2] << "\n";
-    Quat r_ = A.getRotation();
+    QuatT<T> r_ = A.getRotation();
     std::cout << "Quaternion: " << r_[0] << " " << r_[1] << " " << r_[2] << " "<< r_[3] << "\n";
 }
 
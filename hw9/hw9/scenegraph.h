@@ -66,7 +66,7 @@ class SgShapeNode : public SgNode {
 public:
   virtual bool accept(SgNodeVisitor& visitor);
 
-  virtual Matrix4 getAffineMatrix() = 0;
+  virtual AffineMatrix getAffineMatrix() = 0;
   virtual void draw(const Uniforms& uniforms) = 0;
 };
 
@@ -126,7 +126,7 @@ class SgGeometryShapeNode : public SgShapeNode {
 public:
   std::shared_ptr<Geometry> geometry;
   std::shared_ptr<Material> material;
-  Matrix4 affineMatrix;
+  AffineMatrix affineMatrix;
 
   SgGeometryShapeNode(std::shared_ptr<Geometry> _geometry,
                       std::shared_ptr<Material> _material,
@@ -141,18 +141,18 @@ public:
                    Matrix4::makeZRotation(eulerAngles[2]) *
                    Matrix4::makeScale(scales)) {}
 
-  virtual Matrix4 getAffineMatrix() {
+  virtual AffineMatrix getAffineMatrix() {
     return affineMatrix;
   }
 
   void setAffineMatrix(const Cvec3& translation = Cvec3(0, 0, 0),
                        const Cvec3& eulerAngles = Cvec3(0, 0, 0),
                        const Cvec3& scales = Cvec3(1, 1, 1)) {
-    affineMatrix = Matrix4::makeTranslation(translation) *
-                   Matrix4::makeXRotation(eulerAngles[0]) *
-                   Matrix4::makeYRotation(eulerAngles[1]) *
-                   Matrix4::makeZRotation(eulerAngles[2]) *
-                   Matrix4::makeScale(scales);
+    affineMatrix = AffineMatrix(Matrix4::makeTranslation(translation) *
+                                Matrix4::makeXRotation(eulerAngles[0]) *
+                                Matrix4::makeYRotation(eulerAngles[1]) *
+                                Matrix4::makeZRotation(eulerAngles[2]) *
+                                Matrix4::makeScale(scales));
   }
 
   virtual void draw(const Uniforms& uniforms) {
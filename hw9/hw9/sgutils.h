@@ -53,4 +53,11 @@ inline void setSgRbtNodes(std::vector<std::shared_ptr<SgRbtNode>>& rbtNodes, con
     }
 }
 
+//! Same as above, reading rbtNodes.size() RigTForms from a contiguous pose buffer
+inline void setSgRbtNodes(std::vector<std::shared_ptr<SgRbtNode>>& rbtNodes, const RigTForm* poses) {
+    for (unsigned int idx = 0; idx < rbtNodes.size(); ++idx) {
+        rbtNodes[idx]->setRbt(poses[idx]);
+    }
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,260 @@
+#ifndef SIGNEDDISTANCEFIELD_H
+#define SIGNEDDISTANCEFIELD_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "cvec.h"
+#include "mesh.h"
+#include "threadpool.h"
+
+//! Signed distance to a triangle mesh, sampled on a regular grid
+//!
+//! build() computes the exact distance to the nearest triangle at every grid
+//! point, negative inside the mesh. Inside is decided by the six rays from the
+//! point along the grid axes: each ray that crosses the mesh an odd number of
+//! times votes for inside, and a point needs four votes. Unlike face normals
+//! this does not depend on the orientation of the faces, and a hole in the
+//! mesh (like the one under the bunny) only misleads the rays through it.
+//! The distance search is brute force over the triangles, culled by bounding
+//! spheres. Both passes are spread over a thread pool, build() is meant to run
+//! once at load. sample() then costs one trilinear lookup however large the
+//! mesh is.
+class SignedDistanceField {
+public:
+	SignedDistanceField() : cellSize_(0), invCellSize_(0), padding_(0) {
+		dims_[0] = dims_[1] = dims_[2] = 0;
+	}
+
+	//! Sample mesh (object frame) with cubic cells, resolution grid points
+	//! along the longest side of its bounding box grown by padding
+	void build(Mesh& mesh, int resolution, float padding, ThreadPool& pool) {
+		// triangles, polygons are split into fans
+		triangles_.clear();
+		Cvec3f boxMin(std::numeric_limits<float>::max()), boxMax(-std::numeric_limits<float>::max());
+		for (int f = 0; f < mesh.getNumFaces(); ++f) {
+			Mesh::Face face = mesh.getFace(f);
+			const Cvec3f p0(face.getVertex(0).getPosition());
+			for (int j = 2; j < face.getNumVertices(); ++j) {
+				Triangle t;
+				t.p[0] = p0;
+				t.p[1] = Cvec3f(face.getVertex(j - 1).getPosition());
+				t.p[2] = Cvec3f(face.getVertex(j).getPosition());
+				for (int c = 0; c < 3; ++c) {
+					t.min[c] = std::min(std::min(t.p[0][c], t.p[1][c]), t.p[2][c]);
+					t.max[c] = std::max(std::max(t.p[0][c], t.p[1][c]), t.p[2][c]);
+					boxMin[c] = std::min(boxMin[c], t.min[c]);
+					boxMax[c] = std::max(boxMax[c], t.max[c]);
+				}
+				t.center = (t.min + t.max) * 0.5f;
+				t.radius = norm(t.max - t.center);
+				triangles_.push_back(t);
+			}
+		}
+
+		padding_ = padding;
+		origin_ = boxMin - Cvec3f(padding);
+		const Cvec3f extent = boxMax - boxMin + Cvec3f(2 * padding);
+		cellSize_ = std::max(std::max(extent[0], extent[1]), extent[2]) / (resolution - 1);
+		invCellSize_ = 1 / cellSize_;
+		for (int c = 0; c < 3; ++c)
+			dims_[c] = static_cast<int>(std::ceil(extent[c] / cellSize_)) + 1;
+
+		distance_.assign(dims_[0] * dims_[1] * dims_[2], 0.f);
+		std::vector<char> insideVotes(distance_.size(), 0);
+		for (int axis = 0; axis < 3; ++axis)
+			voteInside(axis, insideVotes, pool);
+
+		// one z slice per task, the distance is 1-Lipschitz so each point is at
+		// most one cell further from the mesh than its neighbor in the row before
+		// it, or than the first point of the previous row
+		pool.parallelFor(dims_[2], 1, [&](int begin, int end) {
+			for (int k = begin; k < end; ++k) {
+				float rowStart = std::numeric_limits<float>::max();
+				for (int j = 0; j < dims_[1]; ++j) {
+					float previous = rowStart;
+					for (int i = 0; i < dims_[0]; ++i) {
+						const int index = (k * dims_[1] + j) * dims_[0] + i;
+						previous = unsignedDistance(getGridPoint(i, j, k), previous + cellSize_);
+						distance_[index] = insideVotes[index] >= 4 ? -previous : previous;
+						if (i == 0)
+							rowStart = previous;
+					}
+				}
+			}
+		});
+	}
+
+	bool empty() const {
+		return distance_.empty();
+	}
+
+	//! Signed distance at p (object frame), trilinear between the grid points.
+	//! gradient, if given, receives its gradient, or zero outside the grid where
+	//! the result is only a lower bound of the distance. Points that are not
+	//! finite are infinitely far.
+	float sample(const Cvec3f& p, Cvec3f* gradient = NULL) const {
+		if (!(std::isfinite(p[0]) && std::isfinite(p[1]) && std::isfinite(p[2]))) {
+			if (gradient)
+				*gradient = Cvec3f(0);
+			return std::numeric_limits<float>::infinity();
+		}
+
+		int cell[3];
+		float f[3];
+		float outside2 = 0;
+		for (int c = 0; c < 3; ++c) {
+			const float g = (p[c] - origin_[c]) * invCellSize_;
+			const float beyond = std::max(-g, g - (dims_[c] - 1));
+			if (beyond > 0)
+				outside2 += beyond * beyond;
+			// clamped before the conversion, which is undefined out of the int range
+			cell[c] = static_cast<int>(std::min(std::max(g, 0.f), static_cast<float>(dims_[c] - 2)));
+			f[c] = g - cell[c];
+		}
+		if (outside2 > 0) {
+			if (gradient)
+				*gradient = Cvec3f(0);
+			return std::sqrt(outside2) * cellSize_ + padding_;
+		}
+
+		const int sx = 1, sy = dims_[0], sz = dims_[0] * dims_[1];
+		const float* d = &distance_[cell[2] * sz + cell[1] * sy + cell[0]];
+		const float d000 = d[0], d100 = d[sx], d010 = d[sy], d110 = d[sx + sy];
+		const float d001 = d[sz], d101 = d[sx + sz], d011 = d[sy + sz], d111 = d[sx + sy + sz];
+
+		const float x0 = d000 + (d100 - d000) * f[0], x1 = d010 + (d110 - d010) * f[0];
+		const float x2 = d001 + (d101 - d001) * f[0], x3 = d011 + (d111 - d011) * f[0];
+		const float y0 = x0 + (x1 - x0) * f[1], y1 = x2 + (x3 - x2) * f[1];
+		if (gradient) {
+			const float gx0 = (d100 - d000) + ((d110 - d010) - (d100 - d000)) * f[1];
+			const float gx1 = (d101 - d001) + ((d111 - d011) - (d101 - d001)) * f[1];
+			*gradient = Cvec3f(gx0 + (gx1 - gx0) * f[2],
+			                   (x1 - x0) + ((x3 - x2) - (x1 - x0)) * f[2],
+			                   y1 - y0) * (1.f / cellSize_);
+		}
+		return y0 + (y1 - y0) * f[2];
+	}
+
+	//! Grid points along axis
+	int getDim(int axis) const {
+		return dims_[axis];
+	}
+
+private:
+	struct Triangle {
+		Cvec3f p[3];
+		Cvec3f min, max;          // bounding box
+		Cvec3f center;            // bounding sphere, for culling
+		float radius;
+	};
+
+	Cvec3f getGridPoint(int i, int j, int k) const {
+		return origin_ + Cvec3f(i, j, k) * cellSize_;
+	}
+
+	//! Distance from p to the nearest triangle, given that it is at most bound
+	float unsignedDistance(const Cvec3f& p, float bound) const {
+		float best = bound, best2 = bound * bound;
+		for (std::size_t t = 0; t < triangles_.size(); ++t) {
+			const Triangle& tri = triangles_[t];
+			const float reach = tri.radius + best;
+			if (norm2(p - tri.center) >= reach * reach)
+				continue;
+			const float d2 = norm2(p - closestPoint(p, tri));
+			if (d2 < best2) {
+				best2 = d2;
+				best = std::sqrt(d2);
+			}
+		}
+		return best;
+	}
+
+	//! Closest point to p on triangle t (Ericson, Real-Time Collision Detection 5.1.5)
+	static Cvec3f closestPoint(const Cvec3f& p, const Triangle& t) {
+		const Cvec3f& a = t.p[0], & b = t.p[1], & c = t.p[2];
+		const Cvec3f ab = b - a, ac = c - a, ap = p - a;
+		const float d1 = dot(ab, ap), d2 = dot(ac, ap);
+		if (d1 <= 0 && d2 <= 0)
+			return a;
+
+		const Cvec3f bp = p - b;
+		const float d3 = dot(ab, bp), d4 = dot(ac, bp);
+		if (d3 >= 0 && d4 <= d3)
+			return b;
+
+		const float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0 && d1 >= 0 && d3 <= 0)
+			return a + ab * (d1 / (d1 - d3));
+
+		const Cvec3f cp = p - c;
+		const float d5 = dot(ab, cp), d6 = dot(ac, cp);
+		if (d6 >= 0 && d5 <= d6)
+			return c;
+
+		const float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0 && d2 >= 0 && d6 <= 0)
+			return a + ac * (d2 / (d2 - d6));
+
+		const float va = d3 * d6 - d5 * d4;
+		if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+			return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+		const float denom = 1.f / (va + vb + vc);
+		return a + ab * (vb * denom) + ac * (vc * denom);
+	}
+
+	//! Cast a line along axis through every grid row and give each point one
+	//! vote per direction in which the line crosses the mesh an odd number of times
+	void voteInside(int axis, std::vector<char>& votes, ThreadPool& pool) const {
+		const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+		const int stride[3] = {1, dims_[0], dims_[0] * dims_[1]};
+		pool.parallelFor(dims_[u] * dims_[v], dims_[u], [&](int begin, int end) {
+			std::vector<float> crossings;
+			for (int row = begin; row < end; ++row) {
+				const int iu = row % dims_[u], iv = row / dims_[u];
+				const float pu = origin_[u] + iu * cellSize_, pv = origin_[v] + iv * cellSize_;
+
+				crossings.clear();
+				for (std::size_t t = 0; t < triangles_.size(); ++t) {
+					const Triangle& tri = triangles_[t];
+					if (pu < tri.min[u] || pu > tri.max[u] || pv < tri.min[v] || pv > tri.max[v])
+						continue;
+
+					// barycentric coordinates of the line in the triangle projected along axis
+					const Cvec3f& a = tri.p[0], & b = tri.p[1], & c = tri.p[2];
+					const float area = (b[u] - a[u]) * (c[v] - a[v]) - (c[u] - a[u]) * (b[v] - a[v]);
+					if (area == 0)
+						continue;
+					const float wb = ((pu - a[u]) * (c[v] - a[v]) - (c[u] - a[u]) * (pv - a[v])) / area;
+					const float wc = ((b[u] - a[u]) * (pv - a[v]) - (pu - a[u]) * (b[v] - a[v])) / area;
+					if (wb < 0 || wc < 0 || wb + wc > 1)
+						continue;
+					crossings.push_back(a[axis] + (b[axis] - a[axis]) * wb + (c[axis] - a[axis]) * wc);
+				}
+				std::sort(crossings.begin(), crossings.end());
+
+				int index = iu * stride[u] + iv * stride[v];
+				std::size_t numBefore = 0;
+				for (int i = 0; i < dims_[axis]; ++i, index += stride[axis]) {
+					const float p = origin_[axis] + i * cellSize_;
+					while (numBefore < crossings.size() && crossings[numBefore] < p)
+						numBefore++;
+					votes[index] += (numBefore & 1) + ((crossings.size() - numBefore) & 1);
+				}
+			}
+		});
+	}
+
+	std::vector<Triangle> triangles_;
+	Cvec3f origin_;               // first grid point
+	float cellSize_;
+	float invCellSize_;
+	float padding_;               // distance from the mesh to the grid boundary
+	int dims_[3];                 // grid points along x, y and z
+	std::vector<float> distance_; // signed distance, x fastest
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! Fixed set of worker threads that run data-parallel loops
+//!
+//! parallelFor splits [0, count) into chunks of grain indices which the
+//! workers and the calling thread pick up until none are left, and returns
+//! once every chunk is done. Only one loop runs at a time: parallelFor must
+//! not be called concurrently or from inside a loop body.
+class ThreadPool {
+public:
+	//! Creates a pool using numThreads threads in total (including the caller),
+	//! or one per hardware thread if numThreads <= 0
+	explicit ThreadPool(int numThreads = 0)
+		: job_(NULL), count_(0), grain_(1), next_(0), busy_(0), generation_(0), stop_(false) {
+		if (numThreads <= 0)
+			numThreads = std::max(1u, std::thread::hardware_concurrency());
+		for (int i = 1; i < numThreads; ++i)
+			workers_.emplace_back(&ThreadPool::workerLoop, this);
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		wake_.notify_all();
+		for (std::size_t i = 0; i < workers_.size(); ++i)
+			workers_[i].join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator = (const ThreadPool&) = delete;
+
+	//! Number of threads running loop bodies, the caller included
+	int numThreads() const {
+		return static_cast<int>(workers_.size()) + 1;
+	}
+
+	//! Calls fn(begin, end) on disjoint ranges covering [0, count) and waits for all of them
+	void parallelFor(int count, int grain, const std::function<void(int, int)>& fn) {
+		if (count <= 0)
+			return;
+		grain = std::max(1, grain);
+		if (workers_.empty() || count <= grain) {
+			fn(0, count);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			job_ = &fn;
+			count_ = count;
+			grain_ = grain;
+			next_ = 0;
+			busy_ = static_cast<int>(workers_.size());
+			generation_++;
+		}
+		wake_.notify_all();
+
+		runChunks();
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		done_.wait(lock, [this] { return busy_ == 0; });
+		job_ = NULL;
+	}
+
+private:
+	void runChunks() {
+		for (;;) {
+			const int begin = next_.fetch_add(grain_);
+			if (begin >= count_)
+				return;
+			(*job_)(begin, std::min(begin + grain_, count_));
+		}
+	}
+
+	void workerLoop() {
+		unsigned seen = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+				if (stop_)
+					return;
+				seen = generation_;
+			}
+
+			runChunks();
+
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (--busy_ == 0)
+				done_.notify_one();
+		}
+	}
+
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable wake_;    // signals a new loop or shutdown to the workers
+	std::condition_variable done_;    // signals the caller that all workers finished the loop
+
+	const std::function<void(int, int)>* job_;
+	int count_;
+	int grain_;
+	std::atomic<int> next_;    // first index of the next unclaimed chunk
+	int busy_;                 // workers that have not finished the current loop
+	unsigned generation_;      // incremented for every loop
+	bool stop_;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+//! Hands the latest value from one producer thread to one consumer thread
+//!
+//! The producer fills getWriteBuffer() and calls publish(), the consumer calls
+//! acquire() and reads getReadBuffer(). Each side owns one of the three
+//! buffers, the third one holds the latest published value and is swapped
+//! atomically, so neither side ever waits for the other and the consumer
+//! always sees a complete value. Values published in between two acquire()
+//! calls are dropped, only the latest one is seen.
+template <typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() : write_(0), middle_(1), read_(2) {}
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator = (const TripleBuffer&) = delete;
+
+	//! Producer side: buffer to fill before the next publish()
+	//! Its content is whatever the consumer left in it, not the last published value
+	T& getWriteBuffer() {
+		return buffers_[write_];
+	}
+
+	//! Producer side: make the write buffer the latest value
+	void publish() {
+		write_ = middle_.exchange(write_ | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	//! Consumer side: switch the read buffer to the latest published value,
+	//! returns false (and keeps the read buffer) if nothing was published since the last call
+	bool acquire() {
+		if (!(middle_.load(std::memory_order_relaxed) & FRESH))
+			return false;
+		read_ = middle_.exchange(read_, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	//! Consumer side: value taken by the last successful acquire()
+	const T& getReadBuffer() const {
+		return buffers_[read_];
+	}
+
+	T& getReadBuffer() {
+		return buffers_[read_];
+	}
+
+private:
+	static const int INDEX = 3;    // buffer index bits of middle_
+	static const int FRESH = 4;    // set in middle_ by publish(), cleared by acquire()
+
+	T buffers_[3];
+	int write_;                    // owned by the producer
+	std::atomic<int> middle_;      // shared, index of the latest published buffer
+	int read_;                     // owned by the consumer
+};
+
+#endif
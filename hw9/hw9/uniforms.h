@@ -87,7 +87,7 @@ inline GLenum getTypeForCvec<bool, 4>() { return GL_BOOL_VEC4; }
 // The Uniforms keeps a map from strings to values
 //
 // Currently the value can be of the following type:
-// - Single int, float, or Matrix4
+// - Single int, float, Matrix4 or Matrix4f
 // - Cvec<T, n> with T=int or float, and n = 1, 2, 3, or 4
 // - shared_ptr<Texture>
 // - arrays of any of the above
@@ -112,7 +112,9 @@ public:
     return *this;
   }
 
-  Uniforms& put(const std::string& name, const Matrix4& value) {
+  // Matrix4f is uploaded as is, Matrix4 is converted to float first
+  template<typename T>
+  Uniforms& put(const std::string& name, const Matrix4T<T>& value) {
     valueMap[name].reset(new Matrix4sValue(&value, 1));
     return *this;
   }
@@ -154,7 +156,8 @@ public:
     return *this;
   }
 
-  Uniforms& put(const std::string& name, const Matrix4 *values, int count) {
+  template<typename T>
+  Uniforms& put(const std::string& name, const Matrix4T<T> *values, int count) {
     valueMap[name].reset(new Matrix4sValue(values, count));
     return *this;
   }
@@ -288,13 +291,14 @@ public:
   };
 
   class Matrix4sValue : public Value {
-    // we use cvecs here instead of matrix4s here since matrix4
-    // doesn't allow double element (yet), and to pass the data
-    // into glUniformMatrix4fv, we need to have the internal buffer
-    // to be typed float.
+    // we use cvecs here instead of matrix4s since the matrices are
+    // stored transposed (column-major), and to pass the data into
+    // glUniformMatrix4fv, we need to have the internal buffer
+    // to be typed float. Matrix4f values are copied without conversion.
     std::vector<Cvec<float, 16> > ms_;
 public:
-    Matrix4sValue(const Matrix4 *m, int size)
+    template<typename T>
+    Matrix4sValue(const Matrix4T<T> *m, int size)
       : Value(GL_FLOAT_MAT4, size), ms_(size)
     {
       assert(size > 0);